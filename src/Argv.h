@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cctype>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <module/sys>
+
+/// @brief Arguments of a command line, split at whitespace outside of quotes.
+/// @note
+/// Arguments are views into the command line, which must outlive this. Only arguments with escapes or inner quotes are unescaped, into a buffer owned here, which
+/// is reserved to the size of the command line before the first is written so views into it stay valid. Not copyable or movable, since moving the buffer
+/// could move its contents.
+class Argv
+{
+    std::vector<std::string_view> args;
+    std::string unescaped;
+
+    [[nodiscard]] static bool isEscapable(char c) { return c == ' ' || c == '\\' || c == '"'; }
+
+    std::string_view unescape(std::string_view raw, size_t lineSize)
+    {
+        if (this->unescaped.capacity() < lineSize)
+            this->unescaped.reserve(lineSize);
+
+        const size_t from = this->unescaped.size();
+        for (size_t i = 0; i < raw.size(); i++)
+        {
+            if (raw[i] == '\\' && i + 1 < raw.size() && Argv::isEscapable(raw[i + 1]))
+                this->unescaped.push_back(raw[++i]);
+            else if (raw[i] != '"')
+                this->unescaped.push_back(raw[i]);
+        }
+        return std::string_view(this->unescaped).substr(from);
+    }
+public:
+    explicit Argv(std::string_view cmd)
+    {
+        bool ignoreSpaces = false;
+        for (size_t i = 0; i < cmd.size();)
+        {
+            while (i < cmd.size() && std::isspace(_as(unsigned char, cmd[i])))
+                ++i;
+            if (i == cmd.size())
+                break;
+
+            const size_t begin = i;
+            size_t quotes = 0;
+            bool escaped = false;
+            while (i < cmd.size() && (ignoreSpaces || !std::isspace(_as(unsigned char, cmd[i]))))
+            {
+                if (cmd[i] == '\\' && i + 1 < cmd.size() && Argv::isEscapable(cmd[i + 1]))
+                {
+                    escaped = true;
+                    ++i;
+                }
+                else if (cmd[i] == '"')
+                {
+                    ignoreSpaces = !ignoreSpaces;
+                    ++quotes;
+                }
+                ++i;
+            }
+
+            const std::string_view raw = cmd.substr(begin, i - begin);
+            if (!escaped && quotes == 0)
+                this->args.emplace_back(raw);
+            else if (!escaped && quotes == 2 && raw.front() == '"' && raw.back() == '"')
+                this->args.emplace_back(raw.substr(1, raw.size() - 2)); // Wholly quoted.
+            else
+                this->args.emplace_back(this->unescape(raw, cmd.size()));
+
+            if (i < cmd.size())
+                ++i;
+        }
+    }
+
+    Argv(const Argv&) = delete;
+    Argv(Argv&&) = delete;
+    ~Argv() = default;
+
+    Argv& operator=(const Argv&) = delete;
+    Argv& operator=(Argv&&) = delete;
+
+    [[nodiscard]] bool empty() const { return this->args.empty(); }
+    [[nodiscard]] std::span<const std::string_view> view() const { return this->args; }
+};
@@ -0,0 +1,386 @@
+#pragma once
+
+#include <Preamble.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <codecvt>
+#include <cstddef>
+#include <format>
+#include <initializer_list>
+#include <iterator>
+#include <locale>
+#include <memory>
+#include <ranges>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <Argv.h>
+#include <Config.h>
+#include <Exec.inl>
+#include <Music.h>
+#include <RenderScheduler.h>
+#include <Screen.h>
+#include <TextWidth.h>
+#include <Utf8.h>
+#include <components/Playlist.h>
+
+/// @brief In-process micro-benchmarks, run with the `bench` command.
+/// @note Run on a thread of their own, one at a time, so they don't hold up input or rendering, with their results printed once they're done.
+struct Bench
+{
+    Bench() = delete;
+private:
+    static inline std::atomic<size_t> sink = 0; // Keeps benchmarked work observable.
+    static inline std::atomic<bool> running = false;
+
+    /// @brief What a benchmark prints, collected off the UI thread, to be printed on it once the benchmark's done.
+    struct Report
+    {
+        std::vector<std::string> corpus; // `nameCorpus()`, gathered on the UI thread.
+        std::vector<std::string> lines;
+
+        template <typename... Args>
+        void println(std::format_string<Args...> fmt, Args&&... args)
+        {
+            this->lines.emplace_back(std::format(fmt, std::forward<Args>(args)...));
+        }
+    };
+
+    /// @note Function-local so it's joined before `Screen()`, which it posts to, is torn down.
+    static std::jthread& worker()
+    {
+        static std::jthread ret;
+        return ret;
+    }
+
+    static inline CommandInvocation::Handler noOpHandler = [](std::span<const std::string_view> args) { Bench::sink += args.size(); }; // Called indirectly, like a real one.
+
+    /// @brief Run `func` repeatedly for at least `Config::BenchDuration`.
+    /// @return Mean seconds per call.
+    template <typename Func>
+    static double measure(Func&& func)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        sz iterations = 0_uz;
+        const Clock::time_point begin = Clock::now();
+        Clock::time_point now = begin;
+        do
+        {
+            func();
+            ++iterations;
+            now = Clock::now();
+        } while (now - begin < Config::BenchDuration);
+
+        return std::chrono::duration<double>(now - begin).count() / _as(double, *iterations);
+    }
+
+    /// @brief Track names from the library, or a synthetic mix of ASCII and non-ASCII names without one.
+    static std::vector<std::string> nameCorpus()
+    {
+        std::vector<std::string> ret;
+        for (const MusicPlayer::FoundMusic& track : MusicPlayer::currentLibrary())
+            ret.emplace_back(track.name);
+        _retif(ret, !ret.empty());
+
+        static constexpr std::array<std::string_view, 4> Words { "Symphony No. 9 in D minor, Op. 125", "Für Elise", "残酷な天使のテーゼ", "Café del Mar 🎵" };
+        for (sz i = 0_uz; i < 4096_uz; i++) // NOLINT(readability-magic-numbers)
+            ret.emplace_back(std::string(Words[*i % Words.size()]).append(std::to_string(*i)));
+        return ret;
+    }
+    [[nodiscard]] static std::u32string legacyU32stringFrom(std::string_view str)
+    {
+        try
+        {
+            _push_nowarn_deprecated();
+            return std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t>().from_bytes(str.data(), str.data() + str.size()); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+            _pop_nowarn_deprecated();
+        }
+        catch (const std::range_error&)
+        {
+            return U"";
+        }
+    }
+
+    [[nodiscard]] static std::vector<std::string> legacyArgvParse(std::string_view cmd)
+    {
+        std::vector<std::string> argv;
+        bool ignoreSpaces = false;
+        for (auto it = cmd.begin(); it != cmd.end();) // NOLINT(readability-qualified-auto)
+        {
+            while (it != cmd.end() && std::isspace(*it))
+                ++it; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+            if (it == cmd.end())
+                break;
+
+            std::string arg;
+            while (it != cmd.end() && (ignoreSpaces || !std::isspace(*it)))
+            {
+                if (*it == '\\')
+                {
+                    const auto next = std::next(it); // NOLINT(readability-qualified-auto)
+                    if (next == cmd.end() || (*next != ' ' && *next != '\\' && *next != '"'))
+                        arg.push_back('\\');
+                    else
+                    {
+                        arg.push_back(*next);
+                        ++it; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+                    }
+                }
+                else if (*it == '"')
+                    ignoreSpaces = !ignoreSpaces;
+                else
+                    arg.push_back(*it);
+
+                ++it; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+            }
+            argv.emplace_back(std::move(arg));
+
+            if (it != cmd.end())
+                ++it; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        }
+
+        return argv;
+    }
+    using LegacyHandler = void (*)(const std::vector<std::string>&);
+    using LegacyCommands = std::vector<std::pair<std::vector<std::set<std::string_view>>, LegacyHandler>>;
+    /// @brief The command table as it was before `CommandTrie`, matched by a linear scan over sets of names, with every handler replaced by `handler`.
+    [[nodiscard]] static LegacyCommands legacyCommands(LegacyHandler handler)
+    {
+        LegacyCommands ret;
+        for (const std::string_view names : CommandInvocation::CommandNames)
+        {
+            std::set<std::string_view> alternatives;
+            for (const auto name : std::views::split(names, '|'))
+                alternatives.emplace(std::string_view(name));
+            ret.emplace_back(std::vector { std::move(alternatives) }, handler);
+        }
+        return ret;
+    }
+    static bool legacyMatchExecuteCommand(const LegacyCommands& commands, const std::vector<std::string>& cmd)
+    {
+        if (cmd.empty())
+            return false;
+
+        return std::ranges::any_of(commands, [&](const auto& elem) -> bool
+        {
+            const auto& [startsWith, func] = elem;
+            if (cmd.size() < startsWith.size() || !std::ranges::equal(startsWith, std::span(cmd).first(startsWith.size()), [](const auto& set, const std::string& arg) { return set.contains(arg); }))
+                return false;
+
+            func(cmd);
+            return true;
+        });
+    }
+
+    static void utf8(Report& report)
+    {
+        const std::vector<std::string>& corpus = report.corpus;
+        sz bytes = 0_uz;
+        for (const std::string& str : corpus)
+            bytes += str.size();
+
+        const double legacy = Bench::measure([&]
+        {
+            for (const std::string& str : corpus)
+                Bench::sink += Bench::legacyU32stringFrom(str).size();
+        });
+        const double current = Bench::measure([&]
+        {
+            std::u32string out;
+            for (const std::string& str : corpus)
+            {
+                (void)Utf8::decode(str, out);
+                Bench::sink += out.size();
+            }
+        });
+
+        const double megabytes = _as(double, *bytes) / 1e6; // NOLINT(readability-magic-numbers)
+        report.println("utf8: {} names, {} bytes.", corpus.size(), *bytes);
+        report.println("    `wstring_convert`: {:.1f} MB/s", megabytes / legacy);
+        report.println("    `Utf8::decode`:    {:.1f} MB/s ({:.1f}x)", megabytes / current, legacy / current);
+    }
+
+    static inline std::shared_ptr<const MusicPlayer::PlaylistSnapshot> hitTestPlaylist; // What the benchmarked playlist shows, only touched by the benchmark.
+
+    static void hitTest(Report& report)
+    {
+        static constexpr int Columns = 80, Height = 24, Events = 1000; // Events per measured call, to amortize reading the clock.
+
+        report.println("hit-test: mouse moves over the playlist, by playlist length.");
+        for (const sz rows : { 100_uz, 10'000_uz, 100'000_uz }) // NOLINT(readability-magic-numbers)
+        {
+            Bench::hitTestPlaylist = std::make_shared<const MusicPlayer::PlaylistSnapshot>(MusicPlayer::PlaylistSnapshot { .tracks = std::vector<MusicPlayer::FoundMusic>(*rows), .generation = 0 });
+
+            // Per-row bounds searched linearly, as with every row of a `ui::Menu` reflected into a `ui::Box`.
+            std::vector<ui::Box> boxes(*rows);
+            for (sz i = 0_uz; i < rows; i++)
+                boxes[*i] = ui::Box { .x_min = 0, .x_max = Columns - 1, .y_min = _as(int, *i), .y_max = _as(int, *i) };
+
+            // The playlist itself, scrolled halfway down and laid out as its last frame would have left it.
+            const std::shared_ptr<PlaylistImpl> playlist(new PlaylistImpl([] { return Bench::hitTestPlaylist; }));
+            playlist->bounds = ui::Box { .x_min = 0, .x_max = Columns - 1, .y_min = 0, .y_max = Height - 1 };
+            playlist->rowsBounds = ui::Box { .x_min = 0, .x_max = Columns - 2, .y_min = 0, .y_max = Height - 1 };
+            playlist->scrollTop = i32(rows / 2_uz);
+            playlist->visibleRows = std::min(i32(Height), i32(rows) - playlist->scrollTop);
+            std::vector<ui::Event> moves;
+            for (int y = 0; y < Height; y++)
+            {
+                ui::Mouse mouse;
+                mouse.button = ui::Mouse::None;
+                mouse.motion = ui::Mouse::Moved;
+                mouse.x = Columns / 2;
+                mouse.y = y;
+                moves.emplace_back(ui::Event::Mouse("", mouse));
+            }
+
+            int y = 0;
+            const auto nextY = [&] { return y = _as(int, (_as(size_t, y) + 7919u) % *rows); }; // NOLINT(readability-magic-numbers)
+            const double linear = Bench::measure([&]
+            {
+                for (int i = 0; i < Events; i++)
+                {
+                    const int at = nextY();
+                    Bench::sink += _as(size_t, std::distance(boxes.begin(), std::ranges::find_if(boxes, [&](const ui::Box& box) { return box.Contain(Columns / 2, at); })));
+                }
+            });
+            const double component = Bench::measure([&]
+            {
+                for (int i = 0; i < Events; i++)
+                    Bench::sink += playlist->OnEvent(moves[_as(size_t, i % Height)]) ? _as(size_t, *playlist->hovered) : 0u;
+            });
+
+            report.println("    {:>6} rows: `find_if` {:.1f} ns/event, `Playlist` `OnEvent` {:.1f} ns/event", *rows, linear / Events * 1e9, component / Events * 1e9); // NOLINT(readability-magic-numbers)
+        }
+        Bench::hitTestPlaylist.reset();
+    }
+
+    static void command(Report& report)
+    {
+        // Command lines as typed, each parsed and dispatched to a handler that does nothing, so only getting there is measured.
+        std::vector<std::string> lines { "p", ":n", "seek 42.5", "vo 0.8", R"(play "Für Elise")", R"(play some\ escaped\ name)" };
+        for (const std::string& name : report.corpus)
+            lines.emplace_back("play " + name);
+
+        const LegacyCommands commands = Bench::legacyCommands([](const std::vector<std::string>& args) { Bench::sink += args.size(); });
+        const double legacy = Bench::measure([&]
+        {
+            for (const std::string& line : lines)
+                Bench::sink += Bench::legacyMatchExecuteCommand(commands, Bench::legacyArgvParse(line)) ? 1u : 0u;
+        });
+        const double current = Bench::measure([&]
+        {
+            for (const std::string& line : lines)
+            {
+                const Argv argv(line);
+                Bench::sink += CommandInvocation::dispatch(argv.view(), [](CommandInvocation::Handler, std::span<const std::string_view> args) { Bench::noOpHandler(args); }) ? 1u : 0u;
+            }
+        });
+
+        const auto nanos = [&](double seconds) { return seconds / _as(double, lines.size()) * 1e9; }; // NOLINT(readability-magic-numbers)
+        report.println("command: {} command lines, parsed and dispatched to a no-op handler.", lines.size());
+        report.println("    `std::string` arguments, linear scan: {:.1f} ns/command", nanos(legacy));
+        report.println("    `Argv`, `CommandTrie`:                {:.1f} ns/command ({:.2f}x)", nanos(current), legacy / current);
+    }
+
+    static void wrap(Report& report)
+    {
+        static constexpr size_t Columns = 80;
+
+        // Console-like output: one name per line, with the odd line long enough to wrap.
+        std::string text;
+        for (const std::string& name : report.corpus)
+        {
+            text.append(name);
+            text.push_back(text.size() % 7 == 0 ? '\n' : ' '); // NOLINT(readability-magic-numbers)
+        }
+
+        std::vector<std::pair<size_t, size_t>> byteLines;
+        const double legacy = Bench::measure([&]
+        {
+            // Splits every `Columns` bytes, regardless of what's in them.
+            byteLines.clear();
+            for (size_t i = 0; i < text.size();)
+            {
+                size_t iEnd = i;
+                while (iEnd < text.size() && text[iEnd] != '\n' && iEnd - i < Columns)
+                    iEnd++;
+                byteLines.emplace_back(i, iEnd);
+                i = (iEnd == i || (iEnd < text.size() && text[iEnd] == '\n')) ? iEnd + 1 : iEnd;
+            }
+            Bench::sink += byteLines.size();
+        });
+        std::vector<TextWidth::Line> lines;
+        const double current = Bench::measure([&]
+        {
+            lines.clear();
+            TextWidth::wrap(text, Columns, lines);
+            Bench::sink += lines.size();
+        });
+
+        const double megabytes = _as(double, text.size()) / 1e6; // NOLINT(readability-magic-numbers)
+        report.println("wrap: {} bytes at {} columns.", text.size(), Columns);
+        report.println("    by bytes:              {:.1f} MB/s, {} lines", megabytes / legacy, byteLines.size());
+        report.println("    `TextWidth::wrap`:     {:.1f} MB/s, {} lines ({:.2f}x)", megabytes / current, lines.size(), legacy / current);
+    }
+
+    static constexpr std::array<std::pair<std::string_view, void (*)(Report&)>, 4> Subjects { {
+        { "utf8", &Bench::utf8 },
+        { "hit-test", &Bench::hitTest },
+        { "wrap", &Bench::wrap },
+        { "command", &Bench::command },
+    } };
+public:
+    /// @brief Start the benchmark named `subject` in the background, unless one's already running.
+    /// @return Whether such a benchmark exists.
+    static bool run(std::string_view subject)
+    {
+        for (const auto& [name, func] : Bench::Subjects)
+        {
+            if (name != subject)
+                continue;
+            if (Bench::running.exchange(true))
+            {
+                CommandInvocation::println("[log.error] A benchmark is already running, wait for it to finish.");
+                return true;
+            }
+
+            CommandInvocation::println("Running `{}` in the background...", name);
+            Bench::worker() = std::jthread([func, report = Report { .corpus = Bench::nameCorpus(), .lines = {} }] mutable
+            {
+                func(report);
+                Screen().Post([lines = std::move(report.lines)]
+                {
+                    for (const std::string& line : lines)
+                        CommandInvocation::println("{}", line);
+                    Bench::running = false;
+                    RenderScheduler::request();
+                });
+            });
+            return true;
+        }
+        return false;
+    }
+    /// @brief Names of every benchmark, separated by `|`.
+    static std::string names()
+    {
+        std::string ret;
+        for (const auto& [name, _] : Bench::Subjects)
+            ret.append(name).push_back('|');
+        if (!ret.empty())
+            ret.pop_back();
+        return ret;
+    }
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <Config.h>
+#include <Debug.h>
+#include <Utility.h>
+
+/// @brief A track known to the music library.
+struct LibraryTrack
+{
+    std::string name;
+    std::filesystem::path file;
+    std::string key; // `lookupKeyFrom(name)`, precomputed so lookups never fold names themselves.
+
+    i64 mtime { 0 };
+    u64 size { 0 };
+
+    friend bool operator==(const LibraryTrack&, const LibraryTrack&) = default;
+};
+/// @brief A directory under the music root, with the modification time it was scanned at.
+struct LibraryDirectory
+{
+    std::filesystem::path dir;
+    i64 mtime { 0 };
+};
+/// @brief Everything known about the music library at one point in time.
+struct LibrarySnapshot
+{
+    std::vector<LibraryTrack> tracks; // Sorted by `file`.
+    std::vector<LibraryDirectory> dirs;
+};
+
+/// @brief Persistent binary catalog of the music library.
+/// @note
+/// Layout is a `Header`, then `trackCount` `TrackRecord`s, then `dirCount` `DirRecord`s, then a blob of UTF-8 strings which every `StringRef` indexes into.
+/// A catalog is only considered valid while none of its recorded directories have been modified since, so validation costs one `stat` per directory.
+class LibraryCatalog
+{
+    static constexpr std::array<char, 8> Magic { 'T', 'A', 'C', 'R', 'A', 'D', 'L', 'B' };
+    static constexpr std::uint32_t Version = 2;
+    /// @brief Identifies how `LibraryTrack::key`s were derived, so they're recomputed if that changes.
+    static constexpr std::uint64_t KeyFormat = Config::LookupIgnoresDiacritics ? 1 : 0;
+    static constexpr std::uint32_t ByteOrderMark = 0x01020304; // NOLINT(readability-magic-numbers)
+
+    struct Header
+    {
+        std::array<char, 8> magic;
+        std::uint32_t version;
+        std::uint32_t byteOrder;
+        std::uint64_t keyFormat;
+        std::uint64_t trackCount;
+        std::uint64_t dirCount;
+        std::uint64_t stringsSize;
+    };
+    struct StringRef
+    {
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+    struct TrackRecord
+    {
+        StringRef file;
+        StringRef name;
+        StringRef key;
+        std::int64_t mtime;
+        std::uint64_t size;
+    };
+    struct DirRecord
+    {
+        StringRef dir;
+        std::int64_t mtime;
+    };
+
+    template <typename T>
+    [[nodiscard]] static T readRecord(std::span<const std::byte> bytes, sz at)
+    {
+        T ret;
+        std::memcpy(&ret, bytes.subspan(*at, sizeof(T)).data(), sizeof(T));
+        return ret;
+    }
+    [[nodiscard]] static sys::result<std::string_view> readString(std::span<const std::byte> strings, StringRef ref)
+    {
+        _retif(nullptr, ref.offset > strings.size() || ref.length > strings.size() - ref.offset);
+        return std::string_view(_as(const char*, _as(const void*, strings.subspan(ref.offset, ref.length).data())), ref.length);
+    }
+    static StringRef appendString(std::string& strings, std::string_view str)
+    {
+        const StringRef ret { .offset = strings.size(), .length = str.size() };
+        strings.append(str);
+        return ret;
+    }
+
+    [[nodiscard]] static std::filesystem::path pathFrom(std::string_view str) { return { std::u8string(str.begin(), str.end()) }; }
+public:
+    LibraryCatalog() = delete;
+
+    /// @brief Modification time of `path`, as stored in the catalog, or `0` if it couldn't be read.
+    [[nodiscard]] static i64 mtimeOf(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        const std::filesystem::file_time_type time = std::filesystem::last_write_time(path, ec);
+        return ec ? i64(0) : i64(_as(std::int64_t, time.time_since_epoch().count()));
+    }
+
+    /// @brief Load the catalog at `catalog`, if it exists, is well-formed, and is still up to date with the filesystem.
+    [[nodiscard]] static sys::result<LibrarySnapshot> load(const std::filesystem::path& catalog)
+    {
+        // Read in one go, since every record is copied out into the snapshot anyway.
+        std::ifstream in(catalog, std::ios::binary | std::ios::ate);
+        const std::streamoff length = in ? std::streamoff(in.tellg()) : -1;
+        _retif(nullptr, length <= 0);
+        std::vector<std::byte> buffer(_as(size_t, length));
+        in.seekg(0);
+        in.read(_as(char*, _as(void*, buffer.data())), _as(std::streamsize, length));
+        _retif(nullptr, !in);
+
+        const std::span<const std::byte> bytes = buffer;
+        _retif(nullptr, bytes.size() < sizeof(Header));
+
+        const Header header = LibraryCatalog::readRecord<Header>(bytes, 0_uz);
+        _retif(nullptr, header.magic != LibraryCatalog::Magic || header.version != LibraryCatalog::Version || header.byteOrder != LibraryCatalog::ByteOrderMark ||
+            header.keyFormat != LibraryCatalog::KeyFormat);
+        _retif(nullptr, header.trackCount > bytes.size() / sizeof(TrackRecord) || header.dirCount > bytes.size() / sizeof(DirRecord));
+
+        const sz tracksAt = sizeof(Header);
+        const sz dirsAt = tracksAt + sz(header.trackCount * sizeof(TrackRecord));
+        const sz stringsAt = dirsAt + sz(header.dirCount * sizeof(DirRecord));
+        _retif(nullptr, stringsAt > bytes.size() || bytes.size() - *stringsAt != header.stringsSize);
+        const std::span<const std::byte> strings = bytes.subspan(*stringsAt);
+
+        LibrarySnapshot ret;
+        ret.dirs.reserve(header.dirCount);
+        for (sz i = 0_uz; i < header.dirCount; i++)
+        {
+            const DirRecord rec = LibraryCatalog::readRecord<DirRecord>(bytes, dirsAt + i * sizeof(DirRecord));
+            sys::result<std::string_view> dir = LibraryCatalog::readString(strings, rec.dir);
+            _retif(nullptr, !dir);
+
+            // Any directory changing means a file was added, removed, or renamed beneath it.
+            LibraryDirectory& entry = ret.dirs.emplace_back(LibraryDirectory { .dir = LibraryCatalog::pathFrom(dir.move()), .mtime = i64(rec.mtime) });
+            _retif(nullptr, LibraryCatalog::mtimeOf(entry.dir) != entry.mtime);
+        }
+        _retif(nullptr, ret.dirs.empty());
+
+        ret.tracks.reserve(header.trackCount);
+        for (sz i = 0_uz; i < header.trackCount; i++)
+        {
+            const TrackRecord rec = LibraryCatalog::readRecord<TrackRecord>(bytes, tracksAt + i * sizeof(TrackRecord));
+            sys::result<std::string_view> path = LibraryCatalog::readString(strings, rec.file);
+            sys::result<std::string_view> name = LibraryCatalog::readString(strings, rec.name);
+            sys::result<std::string_view> key = LibraryCatalog::readString(strings, rec.key);
+            _retif(nullptr, !path || !name || !key);
+
+            ret.tracks.emplace_back(LibraryTrack {
+                .name = std::string(name.move()), .file = LibraryCatalog::pathFrom(path.move()), .key = std::string(key.move()), .mtime = i64(rec.mtime), .size = u64(rec.size) });
+        }
+
+        return ret;
+    }
+
+    /// @brief Write `snapshot` to `catalog`, replacing it atomically.
+    /// @note Failures go to `debugLog` rather than the console, so it's safe to call from any thread.
+    static bool save(const std::filesystem::path& catalog, const LibrarySnapshot& snapshot)
+    {
+        namespace fs = std::filesystem;
+
+        std::vector<TrackRecord> tracks;
+        std::vector<DirRecord> dirs;
+        std::string strings;
+        tracks.reserve(snapshot.tracks.size());
+        dirs.reserve(snapshot.dirs.size());
+
+        for (const LibraryTrack& track : snapshot.tracks)
+            tracks.emplace_back(TrackRecord { .file = LibraryCatalog::appendString(strings, stringFrom(track.file.generic_u8string())),
+                                              .name = LibraryCatalog::appendString(strings, track.name),
+                                              .key = LibraryCatalog::appendString(strings, track.key),
+                                              .mtime = *track.mtime,
+                                              .size = *track.size });
+        for (const LibraryDirectory& dir : snapshot.dirs)
+            dirs.emplace_back(DirRecord { .dir = LibraryCatalog::appendString(strings, stringFrom(dir.dir.generic_u8string())), .mtime = *dir.mtime });
+
+        const Header header { .magic = LibraryCatalog::Magic,
+                              .version = LibraryCatalog::Version,
+                              .byteOrder = LibraryCatalog::ByteOrderMark,
+                              .keyFormat = LibraryCatalog::KeyFormat,
+                              .trackCount = tracks.size(),
+                              .dirCount = dirs.size(),
+                              .stringsSize = strings.size() };
+
+        fs::path tmp = catalog;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(_as(const char*, _as(const void*, &header)), sizeof(Header));
+            out.write(_as(const char*, _as(const void*, tracks.data())), _as(std::streamsize, tracks.size() * sizeof(TrackRecord)));
+            out.write(_as(const char*, _as(const void*, dirs.data())), _as(std::streamsize, dirs.size() * sizeof(DirRecord)));
+            out.write(strings.data(), _as(std::streamsize, strings.size()));
+            if (!out)
+            {
+                debugLog("[log.warn] Failed to write library catalog `{}`.", pathToString(tmp));
+                return false;
+            }
+        }
+
+        std::error_code ec;
+        fs::rename(tmp, catalog, ec);
+        if (ec)
+        {
+            debugLog("[log.warn] Failed to replace library catalog `{}`, with error code {}.", pathToString(catalog), ec.value());
+            return false;
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <module/sys>
+
+/// @brief Building blocks of `CommandTrie`, independent of its size.
+class CommandTrieBase
+{
+protected:
+    static constexpr std::uint16_t None = 0xFFFF; // NOLINT(readability-magic-numbers)
+
+    struct Node
+    {
+        char edge = '\0';
+        std::uint16_t firstChild = CommandTrieBase::None;
+        std::uint16_t nextSibling = CommandTrieBase::None;
+        std::uint16_t command = CommandTrieBase::None; // Index of the command this node ends a name of.
+    };
+
+    /// @brief Call `func` with each alternative of `names`.
+    template <typename Func>
+    static constexpr void forEachName(std::string_view names, Func&& func)
+    {
+        for (size_t i = 0; i <= names.size();)
+        {
+            const size_t end = std::min(names.find('|', i), names.size());
+            func(names.substr(i, end - i));
+            i = end + 1;
+        }
+    }
+    /// @brief Insert every name of `commands` into `out`.
+    /// @return The first name that's empty or already taken, or an empty string if there's none.
+    static constexpr std::string_view insertAll(std::span<const std::string_view> commands, std::vector<Node>& out)
+    {
+        std::string_view ret;
+        out.assign(1, Node {});
+        for (size_t command = 0; command < commands.size(); command++)
+        {
+            CommandTrieBase::forEachName(commands[command], [&](std::string_view name)
+            {
+                size_t at = 0;
+                for (const char c : name)
+                {
+                    size_t child = out[at].firstChild, last = CommandTrieBase::None;
+                    for (; child != CommandTrieBase::None && out[child].edge != c; child = out[child].nextSibling)
+                        last = child;
+                    if (child == CommandTrieBase::None)
+                    {
+                        child = out.size();
+                        out.emplace_back(Node { .edge = c });
+                        (last == CommandTrieBase::None ? out[at].firstChild : out[last].nextSibling) = _as(std::uint16_t, child);
+                    }
+                    at = child;
+                }
+
+                if (ret.empty() && (name.empty() || out[at].command != CommandTrieBase::None))
+                    ret = name.empty() ? std::string_view("<empty name>") : name;
+                out[at].command = _as(std::uint16_t, command);
+            });
+        }
+        return ret;
+    }
+public:
+    /// @brief How many nodes the trie over `commands` takes.
+    [[nodiscard]] static constexpr size_t nodesFor(std::span<const std::string_view> commands)
+    {
+        std::vector<Node> nodes;
+        (void)CommandTrieBase::insertAll(commands, nodes);
+        return nodes.size();
+    }
+    /// @brief A name in `commands` that's empty or shared with another command, or an empty string if every name is distinct.
+    [[nodiscard]] static constexpr std::string_view ambiguity(std::span<const std::string_view> commands)
+    {
+        std::vector<Node> nodes;
+        return CommandTrieBase::insertAll(commands, nodes);
+    }
+};
+
+/// @brief Trie over the names of a command table, built at compile time.
+/// @note
+/// Each command is given as its alternative names separated by `|`. Nodes are kept in one array with each node's children linked as siblings, so a lookup
+/// visits at most the siblings along one path, and neither building (done at compile time) nor lookup allocates at runtime.
+template <size_t NodeCount>
+class CommandTrie : public CommandTrieBase
+{
+    std::array<Node, NodeCount> nodes {};
+public:
+    constexpr explicit CommandTrie(std::span<const std::string_view> commands)
+    {
+        std::vector<Node> built;
+        (void)CommandTrieBase::insertAll(commands, built);
+        for (size_t i = 0; i < NodeCount && i < built.size(); i++)
+            this->nodes[i] = built[i];
+    }
+
+    /// @brief Index of the command with a name of exactly `name`.
+    [[nodiscard]] sys::result<sz> find(std::string_view name) const
+    {
+        size_t at = 0;
+        for (const char c : name)
+        {
+            at = this->nodes[at].firstChild;
+            while (at != CommandTrieBase::None && this->nodes[at].edge != c)
+                at = this->nodes[at].nextSibling;
+            _retif(nullptr, at == CommandTrieBase::None);
+        }
+        _retif(nullptr, this->nodes[at].command == CommandTrieBase::None);
+        return sz(this->nodes[at].command);
+    }
+};
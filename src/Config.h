@@ -5,6 +5,8 @@
 #include <chrono>
 #include <string_view>
 
+#include <module/sys>
+
 /// @brief Global static configuration.
 struct Config
 {
@@ -13,11 +15,41 @@ struct Config
     static constexpr std::string_view ApplicationName = "♪♫ tacrad-cli";
     static constexpr std::string_view VersionIdentifier = "v0.1.0-alpha";
 
+    static constexpr std::string_view MusicDirectory = "music/";
+    static constexpr std::string_view LibraryCatalogFile = "library.cat";
+    static constexpr bool LookupIgnoresDiacritics = true; // Whether `é` finds `e`, and vice versa.
+    static constexpr sz LibraryScanThreads = 0_uz; // `0` for the hardware concurrency.
+    static constexpr std::chrono::milliseconds LibraryWatchCoalesceDelay = std::chrono::milliseconds(200);
+    static constexpr std::string_view MetadataCacheFile = "metadata.cache";
+    static constexpr sz MetadataThreads = 0_uz; // `0` for the hardware concurrency.
+    static constexpr std::chrono::milliseconds MetadataRefreshInterval = std::chrono::milliseconds(250);
+    static constexpr std::chrono::milliseconds TagIndexRefreshInterval = std::chrono::milliseconds(2000);
+    static constexpr bool GaplessPlayback = true;        // Whether the next track is opened ahead of time, and started on the frame the current one ends.
+    static constexpr float GaplessPrerollSeconds = 5.0f; // How long before the end of a track the next one is opened.
+    static constexpr std::chrono::seconds DecodeMaxDuration = std::chrono::minutes(20); // Longer tracks are streamed, rather than decoded into memory up front.
+    static constexpr size_t DecodeMaxFileBytes = 96uz << 20u;   // Likewise for larger files, if their duration isn't known yet.
+    static constexpr size_t DecodedAudioBudget = 768uz << 20u;  // Decoded PCM held by the current and next track together, past which they're streamed too.
+    static constexpr size_t PcmCacheBytes = 512uz << 20u;       // Decoded PCM kept for tracks recently played or about to be.
+    static constexpr size_t PcmCacheWarmAhead = 3;              // Playlist entries after the current one decoded ahead of time.
+    static constexpr std::chrono::milliseconds BenchDuration = std::chrono::milliseconds(500); // Minimum runtime of each side of a `bench`.
+
+    static constexpr std::string_view ConsoleHistoryFile = "console.log";
+    static constexpr size_t ConsoleHistoryMemoryCap = 4uz << 20u; // Bytes of console history kept in memory before spilling to `ConsoleHistoryFile`.
+    static constexpr size_t ConsoleHistoryPagedEntries = 256;      // Spilled entries kept in memory once paged back in.
+    static constexpr std::string_view DebugLogFile = "out.log";
+    static constexpr size_t DebugLogRotateBytes = 4uz << 20u; // Once `DebugLogFile` would grow past this, it's moved to `<DebugLogFile>.1` and started afresh.
+    static constexpr size_t DebugLogSlots = 512;             // Records queued before `debugLog` starts dropping them.
+    static constexpr std::chrono::milliseconds DebugLogFlushInterval = std::chrono::milliseconds(100);
+    static constexpr std::string_view TraceFile = "trace.json"; // Where `trace` dumps to by default.
+    static constexpr size_t TraceEventsPerThread = 4096;        // Most recent spans kept by each thread.
+    static constexpr size_t TraceRetiredThreads = 16;           // Exited threads whose spans are kept.
+
     static constexpr char QuickActionKey = ':';
     static constexpr std::chrono::milliseconds QuickActionDelay = std::chrono::milliseconds(1000);
     static constexpr std::chrono::milliseconds StatusBarMessageDelay = std::chrono::milliseconds(3200);
-    static constexpr std::chrono::milliseconds StatusBarDurationRefreshRate = std::chrono::milliseconds(250);
-    static constexpr std::chrono::milliseconds StatusBarDurationRefreshRateInactive = std::chrono::milliseconds(1250);
+    static constexpr std::chrono::milliseconds StatusBarDurationRefreshRate = std::chrono::milliseconds(250); // While playing; nothing ticks otherwise.
+    static constexpr std::chrono::milliseconds SchedulerTick = std::chrono::milliseconds(10);                 // Resolution of `Scheduler` timers.
+    static constexpr std::chrono::milliseconds FrameInterval = std::chrono::milliseconds(16);                 // Minimum time between redraws asked for off input.
 
     static constexpr std::chrono::milliseconds FlavorAnimationDuration = std::chrono::milliseconds(100);
 };
@@ -1,52 +1,246 @@
 #pragma once
 
-#include <cassert>
-#include <chrono>
-#include <cstdlib>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
 #include <format>
 #include <fstream>
-#include <iosfwd>
+#include <ios>
+#include <iterator>
+#include <mutex>
 #include <new>
-#include <ostream>
 #include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include <module/sys>
 
-#define _impl_debug_log(stream_type)                                                                                   \
-    i32 retryCount = 0;                                                                                                \
-    std::chrono::milliseconds retryDelay = std::chrono::milliseconds(32); /* NOLINT(readability-magic-numbers) */      \
-    PrintAgain:                                                                                                        \
-    if (retryCount > 20) /* NOLINT(readability-magic-numbers) */                                                       \
-    {                                                                                                                  \
-        std::exit(0xBADC0DE); /* NOLINT(concurrency-mt-unsafe, readability-magic-numbers): We're giving up anyways. */ \
-    }                                                                                                                  \
-                                                                                                                       \
-    try                                                                                                                \
-    {                                                                                                                  \
-        stream_type out("out.log", stream_type::out | stream_type::app);                                               \
-        out << std::format(std::move(fmt), std::forward<Args>(args)...) << std::endl /* Deliberate. */;                \
-        return;                                                                                                        \
-    }                                                                                                                  \
-    catch (const std::format_error&) /* NOLINT(bugprone-empty-catch) */                                                \
-    { }                                                                                                                \
-    catch (const std::length_error&) /* NOLINT(bugprone-empty-catch) */                                                \
-    { }                                                                                                                \
-    catch (const std::bad_alloc&) /* NOLINT(bugprone-empty-catch) */                                                   \
-    { }                                                                                                                \
-                                                                                                                       \
-    ++retryCount;                                                                                                      \
-    std::this_thread::sleep_for(retryDelay);                                                                           \
-    retryDelay *= 2;                                                                                                   \
-    goto PrintAgain;
+#include <Config.h>
 
-template <typename... Args>
-inline void debugLog(std::format_string<Args...> fmt, Args&&... args /* NOLINT(readability-identifier-naming) */) noexcept
+/// @brief Asynchronous logger behind `debugLog`, writing to `Config::DebugLogFile`.
+/// @note
+/// Callers only claim a slot of a fixed ring, with a compare-and-swap, and copy the format string and arguments into it. String arguments are copied into
+/// the slot (truncated to fit), and everything else by value, so logging never allocates, locks, or touches the file, and is safe from the audio and render
+/// threads. When the ring is full records are dropped, and counted, rather than waited on. A writer thread sleeps until the first record lands in an empty
+/// ring, waits `Config::DebugLogFlushInterval` more for others to join it, then formats everything queued and writes it in one go.
+class DebugLog
 {
-    _impl_debug_log(std::ofstream);
-}
+    static constexpr size_t ArgsCapacity = 96;  // NOLINT(readability-magic-numbers)
+    static constexpr size_t TextCapacity = 384; // NOLINT(readability-magic-numbers)
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence = 0; // Position this slot is next free at, or that plus one once filled.
+        std::string_view fmt;
+        void (*format)(const Slot&, std::string&) = nullptr;
+        alignas(std::max_align_t) std::array<std::byte, DebugLog::ArgsCapacity> args {};
+        std::array<char, DebugLog::TextCapacity> text {};
+    };
+    /// @brief How an argument of type `T` is held until formatted.
+    template <typename T>
+    using Captured = std::conditional_t<std::is_convertible_v<const std::remove_cvref_t<T>&, std::string_view>, std::string_view, std::remove_cvref_t<T>>;
+
+    std::array<Slot, Config::DebugLogSlots> slots;
+    std::atomic<size_t> enqueued = 0;
+    std::atomic<size_t> dropped = 0;
+    std::atomic<bool> pending = false; // Set by the first record queued since the writer last drained, to wake it.
+
+    // Only touched by the writer.
+    size_t dequeued = 0;
+    std::ofstream out;
+    size_t outBytes = 0;
+    std::mutex sleepLock;
+    std::condition_variable_any sleepCv;
+    std::jthread writer;
+
+    DebugLog()
+    {
+        for (size_t i = 0; i < this->slots.size(); i++)
+            this->slots[i].sequence.store(i, std::memory_order_relaxed);
+        this->writer = std::jthread([this](std::stop_token token) { this->run(std::move(token)); });
+    }
+
+    template <typename T>
+    static Captured<T> capture(T&& arg, Slot& slot, size_t& textUsed)
+    {
+        if constexpr (std::is_same_v<Captured<T>, std::string_view>)
+        {
+            const std::string_view str(arg);
+            const size_t len = std::min(str.size(), slot.text.size() - textUsed);
+            std::ranges::copy(str.substr(0, len), std::next(slot.text.begin(), _as(std::ptrdiff_t, textUsed)));
+            textUsed += len;
+            return std::string_view(std::next(slot.text.data(), _as(std::ptrdiff_t, textUsed - len)), len);
+        }
+        else
+            return std::forward<T>(arg);
+    }
+    template <typename Tuple>
+    static void formatSlot(const Slot& slot, std::string& out)
+    {
+        const Tuple& args = *std::launder(_as(const Tuple*, _as(const void*, slot.args.data())));
+        std::apply([&](const auto&... arg) { std::vformat_to(std::back_inserter(out), slot.fmt, std::make_format_args(arg...)); }, args);
+    }
+
+    /// @brief Claim the next free slot.
+    /// @return Its position, or nothing if the ring is full.
+    sys::result<sz> claim() noexcept
+    {
+        size_t pos = this->enqueued.load(std::memory_order_relaxed);
+        while (true)
+        {
+            const size_t sequence = this->slots[pos % this->slots.size()].sequence.load(std::memory_order_acquire);
+            if (sequence == pos)
+            {
+                if (this->enqueued.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return sz(pos);
+            }
+            else if (sequence < pos)
+            {
+                this->dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            else
+                pos = this->enqueued.load(std::memory_order_relaxed);
+        }
+    }
+    /// @brief Format every filled slot, in order, into `batch`.
+    void drain(std::string& batch)
+    {
+        if (const size_t dropped = this->dropped.exchange(0, std::memory_order_relaxed); dropped != 0)
+            std::format_to(std::back_inserter(batch), "[log.warn] Dropped {} log records, the queue was full.\n", dropped);
+
+        while (true)
+        {
+            Slot& slot = this->slots[this->dequeued % this->slots.size()];
+            if (slot.sequence.load(std::memory_order_acquire) != this->dequeued + 1)
+                break;
+
+            try
+            {
+                slot.format(slot, batch);
+            }
+            catch (const std::exception&)
+            {
+                batch.append("<unformattable log record>");
+            }
+            batch.push_back('\n');
+            slot.sequence.store(this->dequeued + this->slots.size(), std::memory_order_release);
+            ++this->dequeued;
+        }
+    }
+    void write(std::string_view batch)
+    {
+        const std::filesystem::path file(Config::DebugLogFile);
+        if (this->out.is_open() && this->outBytes + batch.size() > Config::DebugLogRotateBytes)
+        {
+            this->out.close();
+            std::error_code ec;
+            std::filesystem::rename(file, std::filesystem::path(file).concat(".1"), ec);
+            this->out.open(file, std::ios::binary | std::ios::trunc);
+            this->outBytes = 0;
+        }
+        if (!this->out.is_open())
+        {
+            std::error_code ec;
+            const std::uintmax_t existing = std::filesystem::file_size(file, ec);
+            this->outBytes = ec ? 0 : _as(size_t, existing);
+            this->out.open(file, std::ios::binary | std::ios::app);
+        }
+
+        this->out.write(batch.data(), _as(std::streamsize, batch.size()));
+        this->out.flush();
+        this->outBytes += batch.size();
+        if (!this->out) // Try again from scratch next time.
+        {
+            this->out.close();
+            this->out.clear();
+        }
+    }
+    void run(std::stop_token token)
+    {
+        const std::stop_callback wake(token, [this] noexcept
+        {
+            this->pending.store(true);
+            this->pending.notify_one();
+        });
+
+        std::string batch;
+        while (true)
+        {
+            this->pending.wait(false);
+            if (!token.stop_requested())
+            {
+                std::unique_lock guard(this->sleepLock);
+                (void)this->sleepCv.wait_for(guard, token, Config::DebugLogFlushInterval, [] { return false; });
+            }
+
+            const bool stopping = token.stop_requested(); // Drain once more after being asked to stop.
+            this->pending.store(false);                   // Before draining, so whatever the drain misses wakes the writer again.
+            batch.clear();
+            try
+            {
+                this->drain(batch);
+                if (!batch.empty())
+                    this->write(batch);
+            }
+            catch (const std::exception&) // NOLINT(bugprone-empty-catch): Nowhere left to report it.
+            { }
+            if (stopping)
+                break;
+        }
+    }
+public:
+    DebugLog(const DebugLog&) = delete;
+    DebugLog(DebugLog&&) = delete;
+    ~DebugLog() = default; // Stops the writer, which drains what's left first.
+
+    DebugLog& operator=(const DebugLog&) = delete;
+    DebugLog& operator=(DebugLog&&) = delete;
+
+    static DebugLog& instance()
+    {
+        static DebugLog ret;
+        return ret;
+    }
+
+    /// @brief Queue a record, to be formatted with `fmt` later. Never blocks.
+    template <typename... Args>
+    void push(std::string_view fmt, Args&&... args) noexcept
+    {
+        using Tuple = std::tuple<Captured<Args>...>;
+        static_assert((std::is_trivially_copyable_v<Captured<Args>> && ...), "Log arguments are kept by value until formatted; format others to a string first.");
+        static_assert(sizeof(Tuple) <= DebugLog::ArgsCapacity && alignof(Tuple) <= alignof(std::max_align_t), "Too many log arguments.");
+
+        sys::result<sz> claimed = this->claim();
+        _retif(, !claimed);
+        const size_t pos = *claimed.move();
+
+        Slot& slot = this->slots[pos % this->slots.size()];
+        size_t textUsed = 0;
+        ::new (_as(void*, slot.args.data())) Tuple { DebugLog::capture(std::forward<Args>(args), slot, textUsed)... };
+        slot.fmt = fmt;
+        slot.format = &DebugLog::formatSlot<Tuple>;
+        slot.sequence.store(pos + 1, std::memory_order_release);
+        if (!this->pending.exchange(true))
+            this->pending.notify_one();
+    }
+};
+
+/// @brief Log to `Config::DebugLogFile`, formatted later on the logger's own thread.
+/// @note Never blocks, so is safe from any thread. Records are dropped if the logger falls too far behind.
 template <typename... Args>
-inline void wdebugLog(std::wformat_string<Args...> fmt, Args&&... args /* NOLINT(readability-identifier-naming) */) noexcept
+inline void debugLog(std::format_string<Args...> fmt, Args&&... args /* NOLINT(readability-identifier-naming) */) noexcept
 {
-    _impl_debug_log(std::wofstream);
+    DebugLog::instance().push(fmt.get(), std::forward<Args>(args)...);
 }
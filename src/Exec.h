@@ -2,24 +2,22 @@
 
 #include <Preamble.h>
 
-#include <cstddef>
-#include <cstdlib>
+#include <filesystem>
 #include <format>
-#include <iterator>
 #include <ranges>
 #include <span>
-#include <sstream>
-#include <string>
-#include <utility>
-#include <vector>
+#include <string_view>
 
 #include <module/sys>
 
+#include <Bench.h>
 #include <Exec.inl>
 #include <Music.h>
+#include <RenderScheduler.h>
 #include <Screen.h>
+#include <Trace.h>
 
-inline void CommandInvocation::help(const std::vector<std::string>& cmd)
+inline void CommandInvocation::help(std::span<const std::string_view> cmd)
 {
     if (cmd.size() > 1) [[unlikely]]
     {
@@ -27,24 +25,10 @@ inline void CommandInvocation::help(const std::vector<std::string>& cmd)
         return;
     }
 
-    for (const auto& [query, _] : CommandInvocation::validCommands)
-    {
-        std::string cmdName;
-        for (const auto& tokenSet : query.startsWith)
-        {
-            for (const auto& token : tokenSet)
-                cmdName.append(token).push_back('|');
-            if (!cmdName.empty())
-                cmdName.back() = ' ';
-        }
-        if (!cmdName.empty())
-            cmdName.pop_back();
-        if (!query.exactCount)
-            cmdName.append(" ...");
-        CommandInvocation::println("{}\n    {}\n    {}", cmdName, query.usage, query.desc);
-    }
+    for (const Command& command : CommandInvocation::Commands)
+        CommandInvocation::println("{} ...\n    {}\n    {}", command.names, command.usage, command.desc);
 }
-inline void CommandInvocation::clear(const std::vector<std::string>& cmd)
+inline void CommandInvocation::clear(std::span<const std::string_view> cmd)
 {
     if (cmd.size() > 1) [[unlikely]]
     {
@@ -54,7 +38,7 @@ inline void CommandInvocation::clear(const std::vector<std::string>& cmd)
 
     CommandInvocation::clearHistory();
 }
-inline void CommandInvocation::quit(const std::vector<std::string>& cmd)
+inline void CommandInvocation::quit(std::span<const std::string_view> cmd)
 {
     if (cmd.size() > 1) [[unlikely]]
     {
@@ -65,9 +49,9 @@ inline void CommandInvocation::quit(const std::vector<std::string>& cmd)
     Screen().Exit();
 }
 
-inline void CommandInvocation::togglePlayingOrPlay(const std::vector<std::string>& cmd)
+inline void CommandInvocation::togglePlayingOrPlay(std::span<const std::string_view> cmd)
 {
-    if (cmd.size() == 1 && MusicPlayer::loaded())
+    if (cmd.size() == 1 && MusicPlayer::loadedOrLoading())
     {
         if (MusicPlayer::playing())
         {
@@ -83,7 +67,7 @@ inline void CommandInvocation::togglePlayingOrPlay(const std::vector<std::string
     else
         CommandInvocation::play(cmd);
 }
-inline void CommandInvocation::resumeOrPlay(const std::vector<std::string>& cmd)
+inline void CommandInvocation::resumeOrPlay(std::span<const std::string_view> cmd)
 {
     if (cmd.size() == 1 && !MusicPlayer::playing())
     {
@@ -93,7 +77,7 @@ inline void CommandInvocation::resumeOrPlay(const std::vector<std::string>& cmd)
     else
         CommandInvocation::play(cmd);
 }
-inline void CommandInvocation::play(const std::vector<std::string>& cmd)
+inline void CommandInvocation::play(std::span<const std::string_view> cmd)
 {
     if (cmd.size() < 2) [[unlikely]]
     {
@@ -104,17 +88,10 @@ inline void CommandInvocation::play(const std::vector<std::string>& cmd)
     if (!MusicPlayer::stopMusic())
         CommandInvocation::println("[log.error] Failed to stop track.");
 
-    std::string lookupName = cmd[1];
-    for (const auto& word : std::span(std::next(cmd.begin(), 2), cmd.end()))
-    {
-        lookupName.push_back(' ');
-        lookupName.append(word);
-    }
-
-    if (!MusicPlayer::queryStartMusic(lookupName))
+    if (!MusicPlayer::queryStartMusic(cmd.subspan(1)))
         CommandInvocation::println("[log.error] Failed to start track.");
 }
-inline void CommandInvocation::resume(const std::vector<std::string>& cmd)
+inline void CommandInvocation::resume(std::span<const std::string_view> cmd)
 {
     if (cmd.size() > 1) [[unlikely]]
     {
@@ -125,7 +102,7 @@ inline void CommandInvocation::resume(const std::vector<std::string>& cmd)
     if (!MusicPlayer::resume())
         CommandInvocation::println(R"([log.error] Not currently playing music! Use "play" and "stop" to change media.)");
 }
-inline void CommandInvocation::pause(const std::vector<std::string>& cmd)
+inline void CommandInvocation::pause(std::span<const std::string_view> cmd)
 {
     if (cmd.size() > 1) [[unlikely]]
     {
@@ -136,7 +113,7 @@ inline void CommandInvocation::pause(const std::vector<std::string>& cmd)
     if (!MusicPlayer::pause())
         CommandInvocation::println(R"([log.error] Not currently playing music! Use "play" and "stop" to change media.)");
 }
-inline void CommandInvocation::seek(const std::vector<std::string>& cmd)
+inline void CommandInvocation::seek(std::span<const std::string_view> cmd)
 {
     if (cmd.size() < 2) [[unlikely]]
     {
@@ -155,18 +132,17 @@ inline void CommandInvocation::seek(const std::vector<std::string>& cmd)
         return;
     }
 
-    char* readEnd = nullptr; // NOLINT(misc-const-correctness)
-    const float q = std::strtof(cmd[1].c_str(), &readEnd);
-    if ((readEnd - cmd[1].data()) != _as(ptrdiff_t, cmd[1].size()))
+    sys::result<float> q = floatFrom(cmd[1]);
+    if (!q)
     {
         CommandInvocation::println(R"([log.error] Invalid index argument given to "seek"!)");
         return;
     }
 
-    if (!MusicPlayer::seek(q))
+    if (!MusicPlayer::seek(q.move()))
         CommandInvocation::println("[log.error] Failed to seek track.");
 }
-inline void CommandInvocation::volume(const std::vector<std::string>& cmd)
+inline void CommandInvocation::volume(std::span<const std::string_view> cmd)
 {
     if (cmd.size() < 2) [[unlikely]]
     {
@@ -179,14 +155,19 @@ inline void CommandInvocation::volume(const std::vector<std::string>& cmd)
         return;
     }
 
-    float v = 1.0f; // NOLINT(misc-const-correctness)
-    std::istringstream(cmd[1]) >> v;
-    if (!MusicPlayer::volume(v))
+    sys::result<float> v = floatFrom(cmd[1]);
+    if (!v)
+    {
+        CommandInvocation::println(R"([log.error] Invalid volume argument given to "vo"!)");
+        return;
+    }
+
+    if (!MusicPlayer::volume(v.move()))
         CommandInvocation::println("[log.error] Failed to set volume.");
 }
-inline void CommandInvocation::stop(const std::vector<std::string>&)
+inline void CommandInvocation::stop(std::span<const std::string_view>)
 {
-    if (MusicPlayer::loaded())
+    if (MusicPlayer::loadedOrLoading())
     {
         if (!MusicPlayer::stopMusic())
             CommandInvocation::println("[log.error] Failed to stop track.");
@@ -194,7 +175,7 @@ inline void CommandInvocation::stop(const std::vector<std::string>&)
     else
         CommandInvocation::println(R"([log.error] Not currently playing music! Use "play" to start media.)");
 }
-inline void CommandInvocation::next(const std::vector<std::string>& cmd)
+inline void CommandInvocation::next(std::span<const std::string_view> cmd)
 {
     if (cmd.size() > 1)
         CommandInvocation::println(R"([log.error] Extra arguments given to "next"!)");
@@ -202,3 +183,87 @@ inline void CommandInvocation::next(const std::vector<std::string>& cmd)
     if (!MusicPlayer::next())
         CommandInvocation::println("[log.error] Failed to play next track.");
 }
+inline void CommandInvocation::rescan(std::span<const std::string_view> cmd)
+{
+    if (cmd.size() > 1) [[unlikely]]
+    {
+        CommandInvocation::println(R"([log.error] "rescan" takes no arguments!)");
+        return;
+    }
+
+    if (!MusicPlayer::rescanLibrary())
+    {
+        CommandInvocation::println("[log.error] Couldn't find the music directory `{}`.", Config::MusicDirectory);
+        return;
+    }
+
+    MusicPlayer::currentTrack = i32::sentinel();
+    (void)MusicPlayer::generateShuffledPlaylist();
+    CommandInvocation::println("Found {} tracks.", MusicPlayer::currentLibrary().size());
+}
+inline void CommandInvocation::bench(std::span<const std::string_view> cmd)
+{
+    if (cmd.size() != 2) [[unlikely]]
+    {
+        CommandInvocation::println(R"([log.error] "bench" takes exactly one benchmark, one of `{}`!)", Bench::names());
+        return;
+    }
+
+    if (!Bench::run(cmd[1]))
+        CommandInvocation::println("[log.error] No benchmark named `{}`, expected one of `{}`.", cmd[1], Bench::names());
+}
+inline void CommandInvocation::trace(std::span<const std::string_view> cmd)
+{
+    if (cmd.size() > 2) [[unlikely]]
+    {
+        CommandInvocation::println(R"([log.error] "trace" takes at most a file to write to!)");
+        return;
+    }
+    if constexpr (!Trace::Enabled)
+        CommandInvocation::println("[log.error] Built without tracing, configure with `-DTACRAD_TRACING=ON` to record timings.");
+    else
+    {
+        const std::filesystem::path file(cmd.size() > 1 ? cmd[1] : Config::TraceFile);
+        sys::result<sz> written = Trace::dump(file);
+        if (!written)
+        {
+            CommandInvocation::println("[log.error] Failed to write trace `{}`.", pathToString(file));
+            return;
+        }
+        CommandInvocation::println("Wrote {} spans to `{}`, open it in `chrome://tracing` or Perfetto.", *written.move(), pathToString(file));
+    }
+}
+inline void CommandInvocation::frames(std::span<const std::string_view> cmd)
+{
+    if (cmd.size() > 1) [[unlikely]]
+    {
+        CommandInvocation::println(R"([log.error] "frames" takes no arguments!)");
+        return;
+    }
+    const RenderScheduler::Counters counters = RenderScheduler::counters();
+    CommandInvocation::println("{} frames rendered, {} redraws requested off input, {} coalesced into one already pending, {} skipped as unchanged.", counters.rendered,
+                               counters.requested, counters.coalesced, counters.unchanged);
+}
+inline void CommandInvocation::memory(std::span<const std::string_view> cmd)
+{
+    if (cmd.size() > 1) [[unlikely]]
+    {
+        CommandInvocation::println(R"([log.error] "memory" takes no arguments!)");
+        return;
+    }
+
+    constexpr double MiB = 1024.0 * 1024.0;
+    size_t decoded = 0;
+    for (const MusicPlayer::TrackMemory& track : MusicPlayer::trackMemory())
+    {
+        CommandInvocation::println("`{}`: {}, {:.1f} MiB.", track.name, track.streamed ? "streamed" : "decoded", _as(double, track.bytes) / MiB);
+        if (!track.streamed)
+            decoded += track.bytes;
+    }
+    CommandInvocation::println("{:.1f} of {:.1f} MiB decoded, tracks over {}s or without a known duration over {:.1f} MiB are streamed.", _as(double, decoded) / MiB,
+                               _as(double, Config::DecodedAudioBudget) / MiB, Config::DecodeMaxDuration.count(), _as(double, Config::DecodeMaxFileBytes) / MiB);
+
+    const PcmCache::Stats cache = MusicPlayer::pcmCacheStats();
+    CommandInvocation::println("PCM cache: {} tracks, {:.1f} of {:.1f} MiB, {} hits and {} misses.", cache.tracks, _as(double, cache.bytes) / MiB, _as(double, cache.budget) / MiB,
+                               cache.hits, cache.misses);
+}
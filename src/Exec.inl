@@ -2,99 +2,118 @@
 
 #include <Preamble.h>
 
-#include <algorithm>
+#include <array>
 #include <format>
-#include <initializer_list>
-#include <set>
+#include <span>
 #include <string>
 #include <string_view>
 #include <utility>
-#include <vector>
 
 #include <module/sys>
 
+#include <CommandTrie.h>
+#include <Config.h>
+#include <History.h>
 #include <Screen.h>
 #include <Utility.h>
 
 class CommandInvocation
 {
 public:
-    struct Entry
-    {
-        std::string cmd;
-        std::string output;
-    };
+    using Entry = ConsoleHistory::Entry;
 private:
-    static inline std::vector<Entry> history;
+    static inline ConsoleHistory history { Config::ConsoleHistoryFile, Config::ConsoleHistoryMemoryCap, Config::ConsoleHistoryPagedEntries };
 public:
     CommandInvocation() = delete;
 
     static void clearHistory() { CommandInvocation::history.clear(); }
-    static void pushCommand(std::string cmd) { CommandInvocation::history.emplace_back(Entry { .cmd = std::move(cmd), .output = "" }); }
+    static void pushCommand(std::string cmd) { CommandInvocation::history.push(Entry { .cmd = std::move(cmd), .output = "" }); }
     template <typename... Args>
     static void println(std::format_string<Args...> fmt, Args&&... args)
     {
         if (CommandInvocation::history.empty())
-            CommandInvocation::history.emplace_back(Entry { .cmd = "", .output = "" });
+            CommandInvocation::history.push(Entry { .cmd = "", .output = "" });
 
-        CommandInvocation::history.back().output.append(std::format(fmt, std::forward<Args>(args)...)).push_back('\n');
+        std::string line = std::format(fmt, std::forward<Args>(args)...);
+        line.push_back('\n');
+        CommandInvocation::history.appendOutput(line);
     }
-    static const std::vector<Entry>& rawHistory() { return CommandInvocation::history; }
+    static const ConsoleHistory& rawHistory() { return CommandInvocation::history; }
 
-    static void help(const std::vector<std::string>& cmd);
-    static void clear(const std::vector<std::string>& cmd);
-    static void quit(const std::vector<std::string>& cmd);
+    static void help(std::span<const std::string_view> cmd);
+    static void clear(std::span<const std::string_view> cmd);
+    static void quit(std::span<const std::string_view> cmd);
 
-    static void togglePlayingOrPlay(const std::vector<std::string>& cmd);
-    static void resumeOrPlay(const std::vector<std::string>& cmd);
-    static void play(const std::vector<std::string>& cmd);
-    static void resume(const std::vector<std::string>& cmd);
-    static void pause(const std::vector<std::string>& cmd);
-    static void seek(const std::vector<std::string>& cmd);
-    static void volume(const std::vector<std::string>& cmd);
-    static void stop(const std::vector<std::string>&);
-    static void next(const std::vector<std::string>& cmd);
+    static void togglePlayingOrPlay(std::span<const std::string_view> cmd);
+    static void resumeOrPlay(std::span<const std::string_view> cmd);
+    static void play(std::span<const std::string_view> cmd);
+    static void resume(std::span<const std::string_view> cmd);
+    static void pause(std::span<const std::string_view> cmd);
+    static void seek(std::span<const std::string_view> cmd);
+    static void volume(std::span<const std::string_view> cmd);
+    static void stop(std::span<const std::string_view>);
+    static void next(std::span<const std::string_view> cmd);
+    static void rescan(std::span<const std::string_view> cmd);
+    static void bench(std::span<const std::string_view> cmd);
+    static void trace(std::span<const std::string_view> cmd);
+    static void frames(std::span<const std::string_view> cmd);
+    static void memory(std::span<const std::string_view> cmd);
 private:
-    struct Query
+    friend struct Bench;
+
+    using Handler = void (*)(std::span<const std::string_view>);
+    struct Command
     {
-        std::vector<std::set<std::string_view>> startsWith;
-        std::string usage;
-        std::string desc;
-        bool exactCount = false;
+        std::string_view names; // Alternatives, separated by `|`.
+        std::string_view usage;
+        std::string_view desc;
+        Handler handler;
     };
-    static inline std::vector<std::pair<Query, void (*)(const std::vector<std::string>&)>> validCommands {
-        { Query { .startsWith = { { "p", ":p" } }, .usage = "1. `p`, 2. `p <track query>...`", .desc = "1. Toggle play/pause, 2. Alias for `play`.", .exactCount = false },
-         &CommandInvocation::togglePlayingOrPlay                                                                                                                                                       },
-        { Query { .startsWith = { { ">" } }, .usage = "1. `>`, 2. `> <track query>...`", .desc = "1. Alias for `resume`, 2. Alias for `play`.", .exactCount = false },
-         &CommandInvocation::resumeOrPlay                                                                                                                                                              },
-        { Query { .startsWith = { { "play", "p" } }, .usage = "`play <track query>...`", .desc = "Look for a track matching the query and play it.", .exactCount = false },
-         &CommandInvocation::play                                                                                                                                                                      },
-        { Query { .startsWith = { { "resume", "r", ":r" } }, .usage = "`resume`", .desc = "Resume current track.", .exactCount = false },                                   &CommandInvocation::resume },
-        { Query { .startsWith = { { "pause", "p", "#", ":#" } }, .usage = "`pause`", .desc = "Pause current track.", .exactCount = false },                                 &CommandInvocation::pause  },
-        { Query { .startsWith = { { "seek", "s", "=" } }, .usage = "`seek <seconds>`", .desc = "Seek to the given position in seconds.", .exactCount = false },
-         &CommandInvocation::seek                                                                                                                                                                      },
-        { Query { .startsWith = { { "volume", "vo", "v" } }, .usage = "`vol <linear volume>`", .desc = "Set the volume to the given linear value.", .exactCount = false },
-         &CommandInvocation::volume                                                                                                                                                                    },
-        { Query { .startsWith = { { "stop", "s", ":x" } }, .usage = "`stop`", .desc = "Stop playing music.", .exactCount = false },                                         &CommandInvocation::stop   },
-        { Query { .startsWith = { { "next", "n", ":n" } }, .usage = "`next`", .desc = "Play the next track.", .exactCount = false },                                        &CommandInvocation::next   },
-        { Query { .startsWith = { { "clear", "c", ":c" } }, .usage = "`clear`", .desc = "Clear the console.", .exactCount = false },                                        &CommandInvocation::clear  },
-        { Query { .startsWith = { { "exit", "q", ":q" } }, .usage = "`exit`", .desc = "Exit the program.", .exactCount = false },                                           &CommandInvocation::quit   },
-        { Query { .startsWith = { { "help", "h" } }, .usage = "`help`", .desc = "Show this help message.", .exactCount = false },                                           &CommandInvocation::help   }
-    };
-public:
-    static bool matchExecuteCommand(const std::vector<std::string>& cmd)
+    // Matched on the first argument only, with the rest passed on to the handler.
+    static constexpr std::array<Command, 17> Commands { {
+        { .names = "p|:p", .usage = "1. `p`, 2. `p <track query>...`", .desc = "1. Toggle play/pause, 2. Alias for `play`.", .handler = &CommandInvocation::togglePlayingOrPlay },
+        { .names = ">", .usage = "1. `>`, 2. `> <track query>...`", .desc = "1. Alias for `resume`, 2. Alias for `play`.", .handler = &CommandInvocation::resumeOrPlay },
+        { .names = "play", .usage = "`play <track query>...`", .desc = "Look for a track matching the query and play it.", .handler = &CommandInvocation::play },
+        { .names = "resume|r|:r", .usage = "`resume`", .desc = "Resume current track.", .handler = &CommandInvocation::resume },
+        { .names = "pause|#|:#", .usage = "`pause`", .desc = "Pause current track.", .handler = &CommandInvocation::pause },
+        { .names = "seek|s|=", .usage = "`seek <seconds>`", .desc = "Seek to the given position in seconds.", .handler = &CommandInvocation::seek },
+        { .names = "volume|vo|v", .usage = "`vol <linear volume>`", .desc = "Set the volume to the given linear value.", .handler = &CommandInvocation::volume },
+        { .names = "stop|:x", .usage = "`stop`", .desc = "Stop playing music.", .handler = &CommandInvocation::stop },
+        { .names = "next|n|:n", .usage = "`next`", .desc = "Play the next track.", .handler = &CommandInvocation::next },
+        { .names = "rescan", .usage = "`rescan`", .desc = "Rescan the music directory and rebuild the library catalog.", .handler = &CommandInvocation::rescan },
+        { .names = "bench", .usage = "`bench <benchmark>`", .desc = "Run a micro-benchmark and print its results.", .handler = &CommandInvocation::bench },
+        { .names = "trace", .usage = "`trace [file]`", .desc = "Dump recent hot-path timings as Chrome trace JSON.", .handler = &CommandInvocation::trace },
+        { .names = "memory|mem", .usage = "`memory`", .desc = "Show how much decoded audio is held in memory, and whether tracks are streamed.", .handler = &CommandInvocation::memory },
+        { .names = "frames", .usage = "`frames`", .desc = "Show how many redraws were rendered, coalesced and skipped.", .handler = &CommandInvocation::frames },
+        { .names = "clear|c|:c", .usage = "`clear`", .desc = "Clear the console.", .handler = &CommandInvocation::clear },
+        { .names = "exit|q|:q", .usage = "`exit`", .desc = "Exit the program.", .handler = &CommandInvocation::quit },
+        { .names = "help|h", .usage = "`help`", .desc = "Show this help message.", .handler = &CommandInvocation::help },
+    } };
+    static constexpr std::array<std::string_view, CommandInvocation::Commands.size()> CommandNames = []
+    {
+        std::array<std::string_view, CommandInvocation::Commands.size()> ret;
+        for (size_t i = 0; i < ret.size(); i++)
+            ret[i] = CommandInvocation::Commands[i].names;
+        return ret;
+    }();
+    static_assert(CommandTrieBase::ambiguity(CommandInvocation::CommandNames).empty(), "A command name is empty or shared by more than one command.");
+    static constexpr CommandTrie<CommandTrieBase::nodesFor(CommandInvocation::CommandNames)> Dispatch { CommandInvocation::CommandNames };
+
+    /// @brief Find the command named by the first argument of `cmd`, and hand its handler and `cmd` to `invoke`.
+    template <typename Invoke>
+    static bool dispatch(std::span<const std::string_view> cmd, Invoke&& invoke)
     {
         if (cmd.empty())
             return false;
 
-        return std::ranges::any_of(CommandInvocation::validCommands, [&](const auto& elem) -> bool
-        {
-            const auto& [query, func] = elem;
-            if (cmd.size() < query.startsWith.size() || (query.exactCount && query.startsWith.size() != cmd.size()) || !setVecStartsWith(query.startsWith, cmd))
-                return false;
-
-            func(cmd);
-            return true;
-        });
+        sys::result<sz> found = CommandInvocation::Dispatch.find(cmd.front());
+        _retif(false, !found);
+        std::forward<Invoke>(invoke)(CommandInvocation::Commands[*found.move()].handler, cmd);
+        return true;
+    }
+public:
+    static bool matchExecuteCommand(std::span<const std::string_view> cmd)
+    {
+        return CommandInvocation::dispatch(cmd, [](Handler handler, std::span<const std::string_view> args) { handler(args); });
     }
 };
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <Debug.h>
+#include <Utility.h>
+
+/// @brief Console history, bounded in memory.
+/// @note
+/// The most recent entries are kept in memory, up to a byte cap. Once over it, the oldest entries are appended to an on-disk log and dropped, keeping only their
+/// offsets and sizes, and are paged back in (into a small cache) when indexed. Should the newest entry, which is still being printed to, go over the cap on its
+/// own, all but its last line are split off into an entry of their own and spilled too, leaving the rest to carry on as an entry without a command. The log only
+/// lives as long as the session, so it's truncated on construction.
+class ConsoleHistory
+{
+public:
+    struct Entry
+    {
+        std::string cmd;
+        std::string output;
+    };
+private:
+    static constexpr std::uint64_t Lost = ~std::uint64_t(0); // Offset of an entry that couldn't be spilled.
+    static inline const Entry LostEntry { .cmd = "", .output = "<history lost>\n" };
+
+    struct Spilled
+    {
+        std::uint64_t offset;
+        std::uint64_t bytes; // Of the entry's command and output.
+    };
+
+    std::filesystem::path spillFile;
+    size_t memoryCap;
+    size_t pageCacheSize;
+
+    std::deque<std::shared_ptr<Entry>> resident; // Entries from `spills.size()` onwards, copied before being printed to if they're still held elsewhere.
+    size_t residentBytes = 0;
+    std::vector<Spilled> spills;
+    std::uint64_t spillEnd = 0;
+    std::ofstream spillOut;
+
+    mutable std::ifstream spillIn;
+    mutable std::unordered_map<size_t, std::shared_ptr<const Entry>> paged;
+    mutable std::deque<size_t> pagedOrder; // Oldest paged in first.
+
+    [[nodiscard]] static size_t bytesOf(const Entry& entry) { return entry.cmd.size() + entry.output.size(); }
+
+    void spill(const Entry& entry)
+    {
+        const auto write = [&](std::string_view str)
+        {
+            const auto len = _as(std::uint32_t, str.size());
+            this->spillOut.write(_as(const char*, _as(const void*, &len)), sizeof(len));
+            this->spillOut.write(str.data(), _as(std::streamsize, str.size()));
+        };
+
+        const Spilled lost { .offset = ConsoleHistory::Lost, .bytes = ConsoleHistory::bytesOf(ConsoleHistory::LostEntry) };
+        if (!this->spillOut)
+        {
+            this->spills.emplace_back(lost);
+            return;
+        }
+        write(entry.cmd);
+        write(entry.output);
+        if (!this->spillOut) [[unlikely]]
+        {
+            debugLog("[log.warn] Failed to write console history log `{}`, dropping older history.", pathToString(this->spillFile));
+            this->spills.emplace_back(lost);
+            return;
+        }
+
+        this->spills.emplace_back(Spilled { .offset = this->spillEnd, .bytes = ConsoleHistory::bytesOf(entry) });
+        this->spillEnd += sizeof(std::uint32_t) * 2 + entry.cmd.size() + entry.output.size();
+    }
+    void evict()
+    {
+        // The newest entry is kept, since it's still being printed to.
+        while (this->residentBytes > this->memoryCap && this->resident.size() > 1)
+        {
+            this->spill(*this->resident.front());
+            this->residentBytes -= ConsoleHistory::bytesOf(*this->resident.front());
+            this->resident.pop_front();
+        }
+        // Though if it's over the cap by itself, everything but its last line, which is what's still shown of it elsewhere, is spilled as an entry of its own.
+        if (this->residentBytes > this->memoryCap && !this->resident.empty())
+        {
+            std::shared_ptr<Entry>& live = this->resident.back();
+            const std::string& output = live->output;
+            const size_t lastLine = output.size() < 2 ? std::string::npos : output.rfind('\n', output.size() - 2);
+            if (lastLine != std::string::npos)
+            {
+                const Entry head { .cmd = live->cmd, .output = output.substr(0, lastLine + 1) };
+                live = std::make_shared<Entry>(Entry { .cmd = "", .output = output.substr(lastLine + 1) });
+                this->spill(head);
+                this->residentBytes -= ConsoleHistory::bytesOf(head);
+            }
+        }
+        this->spillOut.flush();
+    }
+    [[nodiscard]] Entry pageIn(size_t at) const
+    {
+        const std::uint64_t offset = this->spills[at].offset;
+        _retif(ConsoleHistory::LostEntry, offset == ConsoleHistory::Lost);
+
+        if (!this->spillIn.is_open())
+            this->spillIn.open(this->spillFile, std::ios::binary);
+        this->spillIn.clear();
+        this->spillIn.seekg(_as(std::streamoff, offset));
+
+        const auto read = [&]
+        {
+            std::uint32_t len = 0;
+            this->spillIn.read(_as(char*, _as(void*, &len)), sizeof(len));
+            std::string ret(this->spillIn ? len : 0u, '\0');
+            this->spillIn.read(ret.data(), _as(std::streamsize, ret.size()));
+            return ret;
+        };
+        Entry ret;
+        ret.cmd = read();
+        ret.output = read();
+        _retif(ConsoleHistory::LostEntry, !this->spillIn);
+        return ret;
+    }
+public:
+    /// @param spillFile Where to spill entries to.
+    /// @param memoryCap How many bytes of entries to keep in memory.
+    /// @param pageCacheSize How many spilled entries to keep in memory once paged back in.
+    ConsoleHistory(std::filesystem::path spillFile, size_t memoryCap, size_t pageCacheSize) :
+        spillFile(std::move(spillFile)), memoryCap(memoryCap), pageCacheSize(pageCacheSize)
+    {
+        this->spillOut.open(this->spillFile, std::ios::binary | std::ios::trunc);
+    }
+
+    ConsoleHistory(const ConsoleHistory&) = delete;
+    ConsoleHistory(ConsoleHistory&&) = delete;
+    ~ConsoleHistory() = default;
+
+    ConsoleHistory& operator=(const ConsoleHistory&) = delete;
+    ConsoleHistory& operator=(ConsoleHistory&&) = delete;
+
+    [[nodiscard]] size_t size() const { return this->spills.size() + this->resident.size(); }
+    [[nodiscard]] bool empty() const { return this->size() == 0; }
+    /// @brief How many of the oldest entries live only on disk.
+    [[nodiscard]] size_t spilled() const { return this->spills.size(); }
+    /// @brief Size of the command and output of entry `at`, without paging it in.
+    [[nodiscard]] size_t bytesAt(size_t at) const
+    {
+        _retif(ConsoleHistory::bytesOf(*this->resident[at - this->spills.size()]), at >= this->spills.size());
+        return _as(size_t, this->spills[at].bytes);
+    }
+
+    /// @brief Entry `at`, paging it in from disk if it was spilled.
+    /// @note Stays valid and unchanged for as long as it's held, even as the history moves on.
+    [[nodiscard]] std::shared_ptr<const Entry> operator[](size_t at) const
+    {
+        _retif(this->resident[at - this->spills.size()], at >= this->spills.size());
+
+        if (const auto it = this->paged.find(at); it != this->paged.end())
+            return it->second;
+
+        while (!this->pagedOrder.empty() && this->paged.size() >= this->pageCacheSize)
+        {
+            this->paged.erase(this->pagedOrder.front());
+            this->pagedOrder.pop_front();
+        }
+        this->pagedOrder.emplace_back(at);
+        return this->paged.insert_or_assign(at, std::make_shared<const Entry>(this->pageIn(at))).first->second;
+    }
+    /// @note Likewise stays valid and unchanged for as long as it's held.
+    [[nodiscard]] std::shared_ptr<const Entry> back() const { return this->resident.back(); }
+
+    void push(Entry entry)
+    {
+        this->residentBytes += ConsoleHistory::bytesOf(entry);
+        this->resident.emplace_back(std::make_shared<Entry>(std::move(entry)));
+        this->evict();
+    }
+    /// @brief Append `str` to the output of the newest entry.
+    void appendOutput(std::string_view str)
+    {
+        std::shared_ptr<Entry>& live = this->resident.back();
+        if (live.use_count() > 1) // Held by a reader, who was promised it won't change.
+            live = std::make_shared<Entry>(*live);
+        live->output.append(str);
+        this->residentBytes += str.size();
+        this->evict();
+    }
+    /// @brief Forget every entry, and truncate the log.
+    void clear()
+    {
+        this->resident.clear();
+        this->residentBytes = 0;
+        this->spills.clear();
+        this->spillEnd = 0;
+        this->paged.clear();
+        this->pagedOrder.clear();
+        this->spillIn.close();
+        this->spillOut.close();
+        this->spillOut.open(this->spillFile, std::ios::binary | std::ios::trunc);
+    }
+};
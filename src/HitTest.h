@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <span>
+#include <vector>
+
+#include <module/sys>
+
+/// @brief Maps a vertical offset into a list to the row under it, without per-row bounds.
+/// @note
+/// Rows of one height are resolved arithmetically. Rows of differing heights fall back to a prefix sum of heights, searched by bisection, so either way the
+/// cost is independent of how many rows there are.
+class RowHitTester
+{
+    int rowHeight = 1;        // When every row has the same height.
+    std::vector<int> rowEnds; // Otherwise, exclusive end offset of each row.
+public:
+    /// @brief Every row is `height` cells high.
+    void uniform(int height)
+    {
+        this->rowHeight = std::max(height, 1);
+        this->rowEnds.clear();
+    }
+    /// @brief Row `i` is `heights[i]` cells high.
+    void variable(std::span<const int> heights)
+    {
+        this->rowEnds.resize(heights.size());
+        int end = 0;
+        for (sz i = 0_uz; i < heights.size(); i++)
+            this->rowEnds[*i] = end += std::max(heights[*i], 0);
+    }
+
+    /// @brief Row under `offset` cells from the top of the first row, out of `rows` rows.
+    [[nodiscard]] sys::result<sz> rowAt(int offset, sz rows) const
+    {
+        _retif(nullptr, offset < 0);
+
+        if (this->rowEnds.empty())
+        {
+            const sz ret(offset / this->rowHeight);
+            _retif(nullptr, ret >= rows);
+            return ret;
+        }
+
+        const auto it = std::ranges::upper_bound(this->rowEnds, offset);
+        _retif(nullptr, it == this->rowEnds.end());
+        const sz ret(std::distance(this->rowEnds.begin(), it));
+        _retif(nullptr, ret >= rows);
+        return ret;
+    }
+};
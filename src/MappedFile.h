@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+#include <module/sys>
+
+#if !_libcxxext_os_windows
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#else
+
+#undef NOMINMAX
+#define NOMINMAX 1 // NOLINT(readability-identifier-naming)
+#undef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1 // NOLINT(readability-identifier-naming)
+#include <Windows.h>
+
+#endif
+
+/// @brief Read-only memory mapping of an entire file.
+/// @note Empty files are treated as unmappable.
+class MappedFile
+{
+    const std::byte* data = nullptr;
+    sz size = 0_uz;
+#if _libcxxext_os_windows
+    HANDLE mapping = nullptr;
+#endif
+public:
+    explicit MappedFile(const std::filesystem::path& path)
+    {
+#if !_libcxxext_os_windows
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT(cppcoreguidelines-pro-type-vararg, hicpp-vararg)
+        _retif(, fd < 0);
+        const sys::destructor _ = [&] noexcept { ::close(fd); };
+
+        struct stat st {};
+        _retif(, ::fstat(fd, &st) != 0 || st.st_size <= 0);
+
+        void* mapped = ::mmap(nullptr, _as(size_t, st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        _retif(, mapped == MAP_FAILED); // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+
+        this->data = _as(const std::byte*, mapped);
+        this->size = sz(_as(size_t, st.st_size));
+#else
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        _retif(, file == INVALID_HANDLE_VALUE);
+        const sys::destructor _ = [&] noexcept { CloseHandle(file); };
+
+        LARGE_INTEGER fileSize {};
+        _retif(, !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0);
+
+        this->mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        _retif(, !this->mapping);
+
+        void* mapped = MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!mapped)
+        {
+            CloseHandle(this->mapping);
+            this->mapping = nullptr;
+            return;
+        }
+
+        this->data = _as(const std::byte*, mapped);
+        this->size = sz(_as(size_t, fileSize.QuadPart));
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile(MappedFile&&) = delete;
+    ~MappedFile()
+    {
+        _retif(, !this->data);
+#if !_libcxxext_os_windows
+        ::munmap(const_cast<std::byte*>(this->data), *this->size); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+#else
+        UnmapViewOfFile(this->data);
+        CloseHandle(this->mapping);
+#endif
+    }
+
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    /// @brief Whether the file was successfully mapped.
+    [[nodiscard]] explicit operator bool() const { return this->data; }
+    /// @brief The mapped contents.
+    [[nodiscard]] std::span<const std::byte> bytes() const { return { this->data, *this->size }; }
+};
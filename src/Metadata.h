@@ -0,0 +1,415 @@
+#pragma once
+
+#include <Preamble.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <audioproperties.h>
+#include <fileref.h>
+#include <tag.h>
+
+#include <module/sys>
+
+#include <Catalog.h>
+#include <Config.h>
+#include <Debug.h>
+#include <MappedFile.h>
+#include <RenderScheduler.h>
+#include <Screen.h>
+#include <Utility.h>
+#include <WorkPool.h>
+
+/// @brief Tags and audio properties of a track.
+struct TrackMetadata
+{
+    std::string title;
+    std::string artist;
+    std::string album;
+    std::string genre;
+    i32 duration { 0 }; // Seconds.
+    i32 bitrate { 0 };  // kbit/s.
+
+    /// @brief How the track should be labelled in lists, falling back to `fallback` when untagged.
+    [[nodiscard]] std::string label(std::string_view fallback) const
+    {
+        if (this->title.empty())
+            return std::string(fallback);
+        if (this->artist.empty())
+            return this->title;
+        return std::format("{} - {}", this->artist, this->title);
+    }
+};
+
+/// @brief Background TagLib metadata extraction, with a persistent cache keyed by path, modification time and size.
+/// @note
+/// `extract` hands the whole library to a long-lived coordinator thread, which stats every track across a `WorkStealingPool`, skips those whose cache entry
+/// matches what's on disk now, and reads the rest. Results become visible to `find` as soon as each track is read, and the UI is asked to redraw at most every
+/// `Config::MetadataRefreshInterval` while extraction is in progress. Indices derived from the metadata are rebuilt on the coordinator too, at most every
+/// `Config::TagIndexRefreshInterval`, so the UI only ever swaps in a finished one. Tracks whose catalog entry turned out stale are handed back to be updated.
+class MetadataStore
+{
+public:
+    /// @brief Invoked on the UI thread with every track whose modification time or size differs from what it was listed with, updated to match the file.
+    using RestatCallback = std::function<void(std::vector<LibraryTrack>)>;
+    /// @brief Invoked on the coordinator thread with the tracks being extracted, with their stats brought up to date, whenever more of their metadata is available.
+    using IndexCallback = std::function<void(std::shared_ptr<const std::vector<LibraryTrack>>)>;
+private:
+    static constexpr std::array<char, 8> Magic { 'T', 'A', 'C', 'R', 'A', 'D', 'M', 'D' };
+    static constexpr std::uint32_t Version = 1;
+
+    struct Entry
+    {
+        i64 mtime { 0 };
+        u64 size { 0 };
+        std::shared_ptr<const TrackMetadata> meta;
+    };
+    struct Jobs
+    {
+        size_t generation = 0;
+        std::shared_ptr<const std::vector<LibraryTrack>> tracks;
+        RestatCallback onRestat;
+        IndexCallback onIndex;
+    };
+
+    static inline std::mutex cacheLock;
+    static inline std::unordered_map<std::filesystem::path, Entry> cache;
+    static inline bool cacheLoaded = false;
+    static inline std::atomic<size_t> cacheGeneration = 0;
+    static inline std::atomic<size_t> runningExtractions = 0;
+
+    static inline std::mutex jobsLock;
+    static inline std::condition_variable_any jobsCv;
+    static inline std::optional<Jobs> pendingJobs; // Not yet started, and replaced by newer extractions.
+    static inline std::atomic<size_t> jobsGeneration = 0;
+
+    /// @note Function-local so it's joined before `Screen()`, which it posts to, is torn down.
+    static std::jthread& coordinator()
+    {
+        static std::jthread ret([](const std::stop_token& token) { MetadataStore::runCoordinator(token); });
+        return ret;
+    }
+    static void runCoordinator(const std::stop_token& token)
+    {
+        while (true)
+        {
+            Jobs jobs;
+            {
+                std::unique_lock guard(MetadataStore::jobsLock);
+                _retif(, !MetadataStore::jobsCv.wait(guard, token, [] { return MetadataStore::pendingJobs.has_value(); }));
+                jobs = std::move(*MetadataStore::pendingJobs);
+                MetadataStore::pendingJobs.reset();
+            }
+            MetadataStore::run(token, std::move(jobs));
+        }
+    }
+
+    [[nodiscard]] static TrackMetadata read(const std::filesystem::path& file)
+    {
+        TrackMetadata ret;
+
+        const TagLib::FileRef ref(file.c_str(), true, TagLib::AudioProperties::Fast);
+        if (ref.isNull())
+            return ret;
+
+        if (const TagLib::Tag* tag = ref.tag())
+        {
+            ret.title = tag->title().to8Bit(true);
+            ret.artist = tag->artist().to8Bit(true);
+            ret.album = tag->album().to8Bit(true);
+            ret.genre = tag->genre().to8Bit(true);
+        }
+        if (const TagLib::AudioProperties* props = ref.audioProperties())
+        {
+            ret.duration = i32(props->lengthInSeconds());
+            ret.bitrate = i32(props->bitrate());
+        }
+
+        return ret;
+    }
+
+    static void appendString(std::string& out, std::string_view str)
+    {
+        const auto len = _as(std::uint32_t, str.size());
+        out.append(_as(const char*, _as(const void*, &len)), sizeof(len));
+        out.append(str);
+    }
+    template <typename T>
+    static void appendValue(std::string& out, T value)
+    {
+        out.append(_as(const char*, _as(const void*, &value)), sizeof(T));
+    }
+    /// @brief Sequential reader over a mapped cache file, which fails closed on truncation.
+    struct Reader
+    {
+        std::span<const std::byte> bytes;
+        bool ok = true;
+
+        template <typename T>
+        T value()
+        {
+            T ret {};
+            if (!this->ok || this->bytes.size() < sizeof(T))
+            {
+                this->ok = false;
+                return ret;
+            }
+            std::memcpy(&ret, this->bytes.data(), sizeof(T));
+            this->bytes = this->bytes.subspan(sizeof(T));
+            return ret;
+        }
+        std::string string()
+        {
+            const auto len = this->value<std::uint32_t>();
+            if (!this->ok || this->bytes.size() < len)
+            {
+                this->ok = false;
+                return {};
+            }
+            std::string ret(_as(const char*, _as(const void*, this->bytes.data())), len);
+            this->bytes = this->bytes.subspan(len);
+            return ret;
+        }
+    };
+
+    static std::unordered_map<std::filesystem::path, Entry> loadCache()
+    {
+        std::unordered_map<std::filesystem::path, Entry> ret;
+
+        const MappedFile file(Config::MetadataCacheFile);
+        _retif(ret, !file);
+
+        Reader reader { .bytes = file.bytes() };
+        const auto magic = reader.value<std::array<char, 8>>();
+        const auto version = reader.value<std::uint32_t>();
+        const auto count = reader.value<std::uint64_t>();
+        _retif(ret, !reader.ok || magic != MetadataStore::Magic || version != MetadataStore::Version);
+
+        ret.reserve(std::min<size_t>(count, reader.bytes.size()));
+        for (std::uint64_t i = 0; i < count && reader.ok; i++)
+        {
+            std::string path = reader.string();
+            Entry entry { .mtime = i64(reader.value<std::int64_t>()), .size = u64(reader.value<std::uint64_t>()), .meta = nullptr };
+            TrackMetadata meta;
+            meta.title = reader.string();
+            meta.artist = reader.string();
+            meta.album = reader.string();
+            meta.genre = reader.string();
+            meta.duration = i32(reader.value<std::int32_t>());
+            meta.bitrate = i32(reader.value<std::int32_t>());
+            _retif({}, !reader.ok);
+
+            entry.meta = std::make_shared<const TrackMetadata>(std::move(meta));
+            ret.insert_or_assign(std::filesystem::path(std::u8string(path.begin(), path.end())), std::move(entry));
+        }
+
+        return ret;
+    }
+    static void saveCache()
+    {
+        std::string out;
+        {
+            const std::unique_lock guard(MetadataStore::cacheLock);
+            out.append(MetadataStore::Magic.data(), MetadataStore::Magic.size());
+            MetadataStore::appendValue(out, MetadataStore::Version);
+            MetadataStore::appendValue(out, _as(std::uint64_t, MetadataStore::cache.size()));
+            for (const auto& [file, entry] : MetadataStore::cache)
+            {
+                MetadataStore::appendString(out, stringFrom(file.generic_u8string()));
+                MetadataStore::appendValue(out, *entry.mtime);
+                MetadataStore::appendValue(out, *entry.size);
+                MetadataStore::appendString(out, entry.meta->title);
+                MetadataStore::appendString(out, entry.meta->artist);
+                MetadataStore::appendString(out, entry.meta->album);
+                MetadataStore::appendString(out, entry.meta->genre);
+                MetadataStore::appendValue(out, *entry.meta->duration);
+                MetadataStore::appendValue(out, *entry.meta->bitrate);
+            }
+        }
+
+        std::filesystem::path tmp(Config::MetadataCacheFile);
+        tmp += ".tmp";
+        {
+            std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+            file.write(out.data(), _as(std::streamsize, out.size()));
+            if (!file)
+            {
+                debugLog("[log.warn] Failed to write metadata cache `{}`.", pathToString(tmp));
+                return;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp, Config::MetadataCacheFile, ec);
+        if (ec)
+            debugLog("[log.warn] Failed to replace metadata cache `{}`, with error code {}.", Config::MetadataCacheFile, ec.value());
+    }
+
+    static void run(const std::stop_token& token, Jobs jobs)
+    {
+        const sys::destructor _ = [] noexcept
+        {
+            --MetadataStore::runningExtractions;
+            RenderScheduler::request();
+        };
+        // Superseded by a newer extraction, or shutting down.
+        const auto stopped = [&] { return token.stop_requested() || jobs.generation != MetadataStore::jobsGeneration.load(); };
+
+        {
+            bool loaded = false;
+            {
+                const std::unique_lock guard(MetadataStore::cacheLock);
+                loaded = MetadataStore::cacheLoaded;
+            }
+            if (!loaded)
+            {
+                std::unordered_map<std::filesystem::path, Entry> fromDisk = MetadataStore::loadCache();
+
+                const std::unique_lock guard(MetadataStore::cacheLock);
+                MetadataStore::cache.merge(fromDisk);
+                MetadataStore::cacheLoaded = true;
+            }
+            ++MetadataStore::cacheGeneration;
+            RenderScheduler::request();
+        }
+        _retif(, stopped());
+        if (jobs.onIndex)
+            jobs.onIndex(jobs.tracks); // Whatever the cache already has.
+        _retif(, jobs.tracks->empty());
+
+        std::atomic<bool> fresh = false, unindexed = false, anyRead = false;
+        std::mutex restatLock;
+        std::vector<LibraryTrack> restated;
+        {
+            WorkStealingPool pool(Config::MetadataThreads);
+            for (const LibraryTrack& track : *jobs.tracks)
+                pool.submit([&stopped, &fresh, &unindexed, &anyRead, &restatLock, &restated, &track](WorkStealingPool&, sz)
+                {
+                    _retif(, stopped());
+
+                    // The catalog only notices files being added or removed, so a file rewritten in place while nothing was watching keeps its old stats there.
+                    std::error_code ec;
+                    const i64 mtime = LibraryCatalog::mtimeOf(track.file);
+                    const u64 size = u64(_as(std::uint64_t, std::filesystem::file_size(track.file, ec)));
+                    _retif(, ec);
+                    if (mtime != track.mtime || size != track.size)
+                    {
+                        LibraryTrack current = track;
+                        current.mtime = mtime;
+                        current.size = size;
+                        const std::unique_lock guard(restatLock);
+                        restated.emplace_back(std::move(current));
+                    }
+
+                    {
+                        const std::unique_lock guard(MetadataStore::cacheLock);
+                        const auto it = MetadataStore::cache.find(track.file);
+                        _retif(, it != MetadataStore::cache.end() && it->second.mtime == mtime && it->second.size == size);
+                    }
+
+                    auto meta = std::make_shared<const TrackMetadata>(MetadataStore::read(track.file));
+                    {
+                        const std::unique_lock guard(MetadataStore::cacheLock);
+                        MetadataStore::cache.insert_or_assign(track.file, Entry { .mtime = mtime, .size = size, .meta = std::move(meta) });
+                    }
+                    ++MetadataStore::cacheGeneration;
+                    fresh.store(true);
+                    unindexed.store(true);
+                    anyRead.store(true);
+                });
+
+            std::chrono::steady_clock::time_point indexed = std::chrono::steady_clock::now();
+            while (!pool.waitFor(Config::MetadataRefreshInterval))
+            {
+                if (fresh.exchange(false))
+                    RenderScheduler::request();
+                if (jobs.onIndex && std::chrono::steady_clock::now() - indexed >= Config::TagIndexRefreshInterval && unindexed.exchange(false) && !stopped())
+                {
+                    jobs.onIndex(jobs.tracks);
+                    indexed = std::chrono::steady_clock::now();
+                }
+            }
+        }
+        _retif(, stopped());
+
+        if (jobs.onIndex && (unindexed.load() || !restated.empty()))
+        {
+            std::unordered_map<std::filesystem::path, const LibraryTrack*> byFile;
+            for (const LibraryTrack& track : restated)
+                byFile.emplace(track.file, &track);
+            auto current = std::make_shared<std::vector<LibraryTrack>>(*jobs.tracks);
+            for (LibraryTrack& track : *current)
+                if (const auto it = byFile.find(track.file); it != byFile.end())
+                    track = *it->second;
+            jobs.onIndex(std::move(current));
+        }
+
+        if (!restated.empty() && jobs.onRestat)
+            Screen().Post([onRestat = std::move(jobs.onRestat), restated = std::move(restated)] mutable { onRestat(std::move(restated)); });
+        if (anyRead.load())
+            MetadataStore::saveCache();
+    }
+public:
+    MetadataStore() = delete;
+
+    /// @brief Metadata of `track`, if it's been read and is still current.
+    /// @note Thread-safe.
+    [[nodiscard]] static std::shared_ptr<const TrackMetadata> find(const LibraryTrack& track)
+    {
+        const std::unique_lock guard(MetadataStore::cacheLock);
+        const auto it = MetadataStore::cache.find(track.file);
+        _retif(nullptr, it == MetadataStore::cache.end() || it->second.mtime != track.mtime || it->second.size != track.size);
+        return it->second.meta;
+    }
+    /// @brief How `track` should be labelled in lists.
+    [[nodiscard]] static std::string label(const LibraryTrack& track)
+    {
+        const std::shared_ptr<const TrackMetadata> meta = MetadataStore::find(track);
+        return meta ? meta->label(track.name) : track.name;
+    }
+    /// @brief Incremented whenever any metadata becomes available.
+    /// @note Thread-safe.
+    [[nodiscard]] static size_t generation() { return MetadataStore::cacheGeneration.load(); }
+    /// @brief Whether an extraction is still in progress.
+    /// @note Thread-safe.
+    [[nodiscard]] static bool extracting() { return MetadataStore::runningExtractions.load() != 0; }
+
+    /// @brief Read metadata for every track in `tracks` not already cached, in the background, superseding any extraction in progress.
+    /// @param onRestat Invoked with the tracks in `tracks` whose stats were out of date, if any, once extraction finishes without being superseded.
+    /// @param onIndex Invoked once the cache is loaded, then as metadata is read, then once more when extraction finishes, unless superseded first.
+    static void extract(std::shared_ptr<const std::vector<LibraryTrack>> tracks, RestatCallback onRestat = nullptr, IndexCallback onIndex = nullptr)
+    {
+        (void)MetadataStore::coordinator();
+
+        ++MetadataStore::runningExtractions;
+        {
+            const std::unique_lock guard(MetadataStore::jobsLock);
+            if (MetadataStore::pendingJobs)
+                --MetadataStore::runningExtractions; // Replaced before it started.
+            MetadataStore::pendingJobs = Jobs { .generation = ++MetadataStore::jobsGeneration, .tracks = std::move(tracks), .onRestat = std::move(onRestat), .onIndex = std::move(onIndex) };
+        }
+        MetadataStore::jobsCv.notify_one();
+    }
+};
@@ -6,30 +6,52 @@
 _push_nowarn_c_cast();
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
 #include <format>
 #include <iterator>
+#include <map>
+#include <memory>
 #include <miniaudio.h>
+#include <mutex>
 #include <new>
 #include <optional>
 #include <random>
+#include <ranges>
+#include <set>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <stop_token>
 #include <system_error>
+#include <thread>
 #include <utility>
 #include <vector>
 _pop_nowarn_c_cast();
 
 #include <module/sys>
 
+#include <Catalog.h>
+#include <Config.h>
 #include <Debug.h>
 #include <Exec.inl>
+#include <Metadata.h>
+#include <PcmCache.h>
+#include <RenderScheduler.h>
+#include <Scanner.h>
+#include <Scheduler.h>
 #include <Screen.h>
+#include <SearchIndex.h>
+#include <TagIndex.h>
+#include <Trace.h>
 #include <Utility.h>
+#include <Watcher.h>
 
 class MusicPlayer
 {
@@ -84,25 +106,550 @@ class MusicPlayer
 
     struct Audio
     {
-        ma_sound sound {}; // _MUST_ be valid.
+        ma_sound sound {};
+        bool open = false; // Whether `sound` was initialized.
         std::string name;
+        std::filesystem::path file;
 
         sys::integer<ma_uint64> prevFrame { 0 };
         sys::integer<ma_uint64> frameLen { 0 };
         float audioLen = -1.0f;
+        bool streamed = false;
+        size_t residentBytes = 0; // PCM held in memory, all of it if decoded, or the pages in flight if streamed.
+        bool scheduled = false; // Whether it's set to start as the current track ends, if it's `upcoming`.
+
+        Audio() = default;
+        Audio(const Audio&) = delete;
+        Audio(Audio&&) = delete;
+        ~Audio()
+        {
+            if (this->open)
+                ma_sound_uninit(&this->sound);
+        }
+
+        Audio& operator=(const Audio&) = delete;
+        Audio& operator=(Audio&&) = delete;
     };
-    static inline std::optional<Audio> audio;
+    static inline std::unique_ptr<Audio> audio;
     static inline std::atomic<bool> hasAudio = false;
+    static inline std::unique_ptr<Audio> upcoming; // The track after `audio`, opened ahead of time for gapless playback.
+    static inline std::filesystem::path upcomingFailed; // Not retried until the track changes.
+    static inline Timer prerollTimer; // Due as the current track comes within `Config::GaplessPrerollSeconds` of its end, and only while it's playing.
+
+    /// @brief A track to open on the loader thread.
+    struct Load
+    {
+        size_t generation = 0; // `loadGeneration` when asked for, and dropped once that's moved on.
+        LibraryTrack track;
+        bool stream = false;
+        bool upcoming = false; // For `upcoming`, rather than `audio`.
+    };
+    struct Loaded
+    {
+        Load load;
+        std::unique_ptr<Audio> audio; // `nullptr` if it couldn't be opened, with `error` saying why.
+        std::string error;
+    };
+    static inline std::mutex loadLock;
+    static inline std::condition_variable_any loadCv;
+    static inline std::optional<Load> pendingLoad, pendingUpcoming;   // Not yet started, and replaced by newer loads.
+    static inline std::optional<Loaded> loadedAudio, loadedUpcoming; // Not yet picked up by the UI thread.
+    static inline std::atomic<size_t> loadGeneration = 0;
+    static inline std::string loadingName;               // Of the track being loaded as `audio`, if any.
+    static inline std::filesystem::path upcomingLoading; // Of the track being loaded as `upcoming`, if any.
 public:
-    struct FoundMusic
+    using FoundMusic = LibraryTrack;
+    /// @brief One immutable version of the playlist.
+    struct PlaylistSnapshot
     {
-        std::string name;
-        std::filesystem::path file;
-
-        friend bool operator==(const FoundMusic&, const FoundMusic&) = default;
+        std::vector<FoundMusic> tracks;
+        size_t generation = 0; // Distinct for every version published.
     };
 private:
-    static inline std::vector<FoundMusic> playlist;
+    static inline std::vector<FoundMusic> library; // Sorted by `FoundMusic::file`.
+    static inline std::vector<LibraryDirectory> libraryDirs;
+    static inline bool libraryLoaded = false;
+    static inline TrackSearchIndex searchIndex;
+    static inline std::atomic<std::shared_ptr<const TagIndex>> tagIndex { std::make_shared<const TagIndex>() }; // Built on the metadata coordinator thread.
+    static inline std::set<Tag> tagFilter;
+    static inline std::vector<FoundMusic> untaggedAdditions; // Added under `tagFilter` before their tags were read, to join the playlist once they are, if they match.
+    static inline std::atomic<size_t> playlistGenerations = 0;
+    static inline std::atomic<std::shared_ptr<const PlaylistSnapshot>> playlist { std::make_shared<const PlaylistSnapshot>() };
+
+    /// @brief Replace the playlist with `tracks`, as a new version.
+    static void publishPlaylist(std::vector<FoundMusic> tracks)
+    {
+        MusicPlayer::playlist.store(std::make_shared<const PlaylistSnapshot>(PlaylistSnapshot { .tracks = std::move(tracks), .generation = ++MusicPlayer::playlistGenerations }));
+    }
+
+    /// @note Function-local so it's torn down before `Screen()`, which it posts to.
+    static LibraryWatcher& libraryWatcher()
+    {
+        static LibraryWatcher ret;
+        return ret;
+    }
+    /// @brief Bring everything derived from `library` up to date with it.
+    static void libraryChanged()
+    {
+        MusicPlayer::searchIndex.rebuild(MusicPlayer::library);
+        MetadataStore::extract(std::make_shared<const std::vector<FoundMusic>>(MusicPlayer::library),
+                               [](std::vector<FoundMusic> restated) { MusicPlayer::applyRestatedTracks(std::move(restated)); },
+                               [](std::shared_ptr<const std::vector<FoundMusic>> tracks)
+        {
+            MusicPlayer::tagIndex.store(std::make_shared<const TagIndex>(std::move(tracks)));
+            Screen().Post([] { MusicPlayer::admitUntaggedAdditions(); });
+            RenderScheduler::request();
+        });
+    }
+    /// @brief Insert `track` into `tracks` somewhere after the current track, so as not to disturb what's already played.
+    static void insertUnplayed(std::vector<FoundMusic>& tracks, FoundMusic track)
+    {
+        const sz from = MusicPlayer::currentTrack >= 0_i32 ? std::min(sz(MusicPlayer::currentTrack) + 1_uz, sz(tracks.size())) : 0_uz;
+        std::uniform_int_distribution<size_t> at(*from, tracks.size());
+        tracks.insert(std::next(tracks.begin(), _as(ptrdiff_t, at(MusicPlayer::randEngine))), std::move(track));
+    }
+    /// @brief Let any `untaggedAdditions` whose tags have since been read and match `tagFilter` into the playlist.
+    static void admitUntaggedAdditions()
+    {
+        _retif(, MusicPlayer::untaggedAdditions.empty());
+
+        std::vector<FoundMusic> tracks = MusicPlayer::currentPlaylist()->tracks;
+        bool admitted = false;
+        std::erase_if(MusicPlayer::untaggedAdditions, [&](const FoundMusic& track)
+        {
+            // Dropped from the library since.
+            const auto it = std::ranges::lower_bound(MusicPlayer::library, track.file, {}, &FoundMusic::file);
+            _retif(true, it == MusicPlayer::library.end() || it->file != track.file);
+
+            const std::shared_ptr<const TrackMetadata> meta = MetadataStore::find(*it);
+            _retif(false, !meta);
+            if (TagIndex::matches(MusicPlayer::tagFilter, *meta))
+            {
+                MusicPlayer::insertUnplayed(tracks, *it);
+                admitted = true;
+            }
+            return true;
+        });
+        if (admitted)
+            MusicPlayer::publishPlaylist(std::move(tracks));
+    }
+    static void watchLibrary()
+    {
+        MusicPlayer::libraryWatcher().watch(MusicPlayer::libraryDirs, [](LibraryChanges changes) { MusicPlayer::applyLibraryChanges(std::move(changes)); });
+    }
+
+    /// @brief Make sure `library` is populated, preferring the on-disk catalog over walking `Config::MusicDirectory`.
+    static void ensureLibrary()
+    {
+        _retif(, MusicPlayer::libraryLoaded);
+
+        if (sys::result<LibrarySnapshot> snapshot = LibraryCatalog::load(Config::LibraryCatalogFile))
+        {
+            LibrarySnapshot loaded = snapshot.move();
+            MusicPlayer::library = std::move(loaded.tracks);
+            MusicPlayer::libraryDirs = std::move(loaded.dirs);
+            MusicPlayer::watchLibrary();
+            MusicPlayer::libraryChanged();
+        }
+        else
+            (void)MusicPlayer::rescanLibrary();
+
+        MusicPlayer::libraryLoaded = true;
+    }
+    /// @brief Apply a batch of changes from the library watcher to the library and playlist, without reshuffling.
+    static void applyLibraryChanges(LibraryChanges changes)
+    {
+        if (changes.rescanned)
+        {
+            // Already scanned, saved and watched by the watcher, so only taken up here.
+            MusicPlayer::library = std::move(changes.rescanned->tracks);
+            MusicPlayer::libraryDirs = std::move(changes.rescanned->dirs);
+            MusicPlayer::libraryChanged();
+            MusicPlayer::currentTrack = i32::sentinel();
+            (void)MusicPlayer::generateShuffledPlaylist();
+
+            changes.rescanned.reset();
+            _retif(, changes.empty());
+        }
+
+        const auto isRemoved = [&](const FoundMusic& track)
+        {
+            return changes.removed.contains(track.file) ||
+                std::ranges::any_of(changes.removedDirs, [&](const std::filesystem::path& dir) { return LibraryChanges::beneath(track.file, dir); });
+        };
+
+        // Rewritten tracks are updated in place, removed ones dropped, keeping `currentTrack` pointed at the same track (or just before it, if it was dropped).
+        const std::shared_ptr<const PlaylistSnapshot> old = MusicPlayer::currentPlaylist();
+        std::vector<FoundMusic> kept;
+        std::set<std::filesystem::path> replaced;
+        kept.reserve(old->tracks.size() + changes.added.size());
+        i32 current = MusicPlayer::currentTrack;
+        for (sz i = 0_uz; i < old->tracks.size(); i++)
+        {
+            const FoundMusic& track = old->tracks[*i];
+            if (const auto it = changes.added.find(track.file); it != changes.added.end())
+            {
+                kept.emplace_back(it->second);
+                replaced.insert(it->first);
+            }
+            else if (!isRemoved(track))
+                kept.emplace_back(track);
+            else if (MusicPlayer::currentTrack >= 0_i32 && i <= sz(MusicPlayer::currentTrack))
+                --current;
+        }
+        MusicPlayer::currentTrack = current;
+
+        for (const auto& [file, track] : changes.added)
+        {
+            if (replaced.contains(file))
+                continue;
+
+            // Under a tag filter, only new tracks matching it join the playlist, as with `generateShuffledPlaylist`. Those not yet read wait until they are.
+            if (!MusicPlayer::tagFilter.empty())
+            {
+                const std::shared_ptr<const TrackMetadata> meta = MetadataStore::find(track);
+                if (!meta)
+                    MusicPlayer::untaggedAdditions.emplace_back(track);
+                if (!meta || !TagIndex::matches(MusicPlayer::tagFilter, *meta))
+                    continue;
+            }
+            MusicPlayer::insertUnplayed(kept, track);
+        }
+        MusicPlayer::publishPlaylist(std::move(kept));
+
+        std::erase_if(MusicPlayer::library, [&](const FoundMusic& track) { return isRemoved(track) || changes.added.contains(track.file); });
+        std::vector<FoundMusic> merged;
+        merged.reserve(MusicPlayer::library.size() + changes.added.size());
+        std::ranges::merge(MusicPlayer::library | std::views::as_rvalue, changes.added | std::views::values, std::back_inserter(merged), {}, &FoundMusic::file, &FoundMusic::file);
+        MusicPlayer::library = std::move(merged);
+
+        std::erase_if(MusicPlayer::libraryDirs, [&](const LibraryDirectory& dir)
+        {
+            return changes.dirs.contains(dir.dir) ||
+                std::ranges::any_of(changes.removedDirs, [&](const std::filesystem::path& removed) { return dir.dir == removed || LibraryChanges::beneath(dir.dir, removed); });
+        });
+        for (const auto& [dir, mtime] : changes.dirs)
+            MusicPlayer::libraryDirs.emplace_back(LibraryDirectory { .dir = dir, .mtime = mtime });
+
+        MusicPlayer::libraryWatcher().save(std::make_shared<const LibrarySnapshot>(LibrarySnapshot { .tracks = MusicPlayer::library, .dirs = MusicPlayer::libraryDirs }));
+        MusicPlayer::libraryChanged();
+    }
+
+    /// @brief Update the stats of tracks found rewritten since they were listed, in the library, the playlist, and the catalog.
+    static void applyRestatedTracks(std::vector<FoundMusic> restated)
+    {
+        std::map<std::filesystem::path, FoundMusic> byFile;
+        for (FoundMusic& track : restated)
+        {
+            // Dropped from the library since, so not brought back.
+            const auto it = std::ranges::lower_bound(MusicPlayer::library, track.file, {}, &FoundMusic::file);
+            if (it == MusicPlayer::library.end() || it->file != track.file)
+                continue;
+
+            it->mtime = track.mtime;
+            it->size = track.size;
+            byFile.insert_or_assign(track.file, std::move(track));
+        }
+        _retif(, byFile.empty());
+
+        const std::shared_ptr<const PlaylistSnapshot> old = MusicPlayer::currentPlaylist();
+        std::vector<FoundMusic> tracks = old->tracks;
+        for (FoundMusic& track : tracks)
+            if (const auto it = byFile.find(track.file); it != byFile.end())
+                track = it->second;
+        MusicPlayer::publishPlaylist(std::move(tracks));
+
+        MusicPlayer::libraryWatcher().save(std::make_shared<const LibrarySnapshot>(LibrarySnapshot { .tracks = MusicPlayer::library, .dirs = MusicPlayer::libraryDirs }));
+        RenderScheduler::request();
+    }
+
+    /// @note Function-local, and made after the audio engine, so it's torn down before the engine whose resource manager it holds buffers in.
+    static PcmCache& pcmCache()
+    {
+        static PcmCache ret(ma_engine_get_resource_manager(&MusicPlayer::audioEngine()), Config::PcmCacheBytes);
+        return ret;
+    }
+    /// @note
+    /// Function-local so it's joined before `Screen()`, which it posts to, is torn down. The audio engine it opens tracks with, and the PCM cache it keeps them
+    /// in, are made first, so the thread is joined before those are torn down too.
+    static std::jthread& loader()
+    {
+        (void)MusicPlayer::pcmCache();
+        static std::jthread ret([](const std::stop_token& token) { MusicPlayer::runLoader(token); });
+        return ret;
+    }
+    static void runLoader(const std::stop_token& token)
+    {
+        _trace_thread("track loader");
+        while (true)
+        {
+            Load load;
+            {
+                std::unique_lock guard(MusicPlayer::loadLock);
+                _retif(, !MusicPlayer::loadCv.wait(guard, token, [] { return MusicPlayer::pendingLoad || MusicPlayer::pendingUpcoming; }));
+                std::optional<Load>& next = MusicPlayer::pendingLoad ? MusicPlayer::pendingLoad : MusicPlayer::pendingUpcoming;
+                load = std::move(*next);
+                next.reset();
+            }
+            if (load.generation != MusicPlayer::loadGeneration.load())
+                continue; // Superseded before it started.
+
+            Loaded done { .load = std::move(load), .audio = nullptr, .error = "" };
+            const bool cached = !done.load.stream && MusicPlayer::pcmCache().touch(done.load.track.file);
+            done.audio = MusicPlayer::openAudio(done.load.track, done.load.stream, done.error);
+            if (done.audio && !done.load.stream && !cached)
+                (void)MusicPlayer::pcmCache().retain(done.load.track.file); // Shares the buffer just decoded, so it's kept for next time.
+            std::optional<Loaded> stale; // Dropped outside the lock.
+            {
+                const std::unique_lock guard(MusicPlayer::loadLock);
+                std::optional<Loaded>& slot = done.load.upcoming ? MusicPlayer::loadedUpcoming : MusicPlayer::loadedAudio;
+                stale = std::exchange(slot, std::move(done));
+            }
+            Screen().Post([] { MusicPlayer::finishLoads(); });
+        }
+    }
+    /// @brief Take up whatever the loader thread finished opening, unless it's since been superseded.
+    static void finishLoads()
+    {
+        std::optional<Loaded> current, ahead;
+        {
+            const std::unique_lock guard(MusicPlayer::loadLock);
+            current = std::exchange(MusicPlayer::loadedAudio, std::nullopt);
+            ahead = std::exchange(MusicPlayer::loadedUpcoming, std::nullopt);
+        }
+
+        if (current && current->load.generation == MusicPlayer::loadGeneration.load())
+        {
+            MusicPlayer::loadingName.clear();
+            RenderScheduler::request();
+            if (!current->audio)
+                CommandInvocation::println("[log.error] {}", current->error);
+            else
+            {
+                MusicPlayer::audio = std::move(current->audio);
+                MusicPlayer::hasAudio = true;
+                if (MusicPlayer::isPlaying.load() && !MusicPlayer::resume())
+                {
+                    CommandInvocation::println("[log.error] Failed to resume track.");
+                    MusicPlayer::audio = nullptr;
+                    MusicPlayer::hasAudio = false;
+                }
+                else
+                    MusicPlayer::warmAhead();
+            }
+        }
+
+        if (ahead && ahead->load.generation == MusicPlayer::loadGeneration.load() && ahead->load.track.file == MusicPlayer::upcomingLoading)
+        {
+            MusicPlayer::upcomingLoading.clear();
+            if (!ahead->audio)
+            {
+                debugLog("[log.warn] Failed to open next track ahead of time: {}", ahead->error);
+                MusicPlayer::upcomingFailed = ahead->load.track.file;
+            }
+            else
+            {
+                MusicPlayer::upcoming = std::move(ahead->audio);
+                MusicPlayer::prepareUpcoming();
+            }
+        }
+    }
+
+    /// @brief Whether `track` should be streamed rather than decoded up front, given `decodedElsewhere` bytes of PCM already held by another track.
+    /// @note
+    /// Decoded tracks cost their whole length in memory, but never touch the disk again, while streamed ones hold a couple of pages at a time. Durations come
+    /// from the metadata cache, falling back on the size of the file while it hasn't been read.
+    [[nodiscard]] static bool streams(const LibraryTrack& track, size_t decodedElsewhere)
+    {
+        const std::shared_ptr<const TrackMetadata> meta = MetadataStore::find(track);
+        _retif(*track.size > Config::DecodeMaxFileBytes, !meta || meta->duration <= 0_i32);
+        _retif(true, std::chrono::seconds(*meta->duration) > Config::DecodeMaxDuration);
+
+        ma_engine& engine = MusicPlayer::audioEngine();
+        const size_t estimate = _as(size_t, *meta->duration) * ma_engine_get_sample_rate(&engine) * ma_engine_get_channels(&engine) * sizeof(float);
+        return decodedElsewhere + estimate > Config::DecodedAudioBudget;
+    }
+    /// @brief Open `track` as a stopped sound, ready to start.
+    /// @note Thread-safe, reporting failures through `error` rather than the console.
+    [[nodiscard]] static std::unique_ptr<Audio> openAudio(const LibraryTrack& track, bool stream, std::string& error)
+    {
+        namespace fs = std::filesystem;
+        _trace_scope("track load");
+
+        const std::filesystem::path& file = track.file;
+        const ma_uint32 flags = MA_SOUND_FLAG_NO_SPATIALIZATION | (stream ? MA_SOUND_FLAG_STREAM : MA_SOUND_FLAG_DECODE);
+        auto ret = std::make_unique<Audio>();
+#if _libcxxext_os_windows
+        if (const ma_result res = ma_sound_init_from_file_w(&MusicPlayer::audioEngine(), file.c_str(), flags, nullptr, nullptr, &ret->sound);
+#else
+        if (const ma_result res = ma_sound_init_from_file(&MusicPlayer::audioEngine(), file.string().c_str(), flags, nullptr, nullptr, &ret->sound);
+#endif
+            res != MA_SUCCESS)
+        {
+            error = std::format("Failed to load track `{}`, with error code {}.", stringFrom(fs::path(file).generic_u8string()), _as(int, res));
+            return nullptr;
+        }
+        ret->open = true;
+
+        if (ma_result res = ma_sound_get_length_in_pcm_frames(&ret->sound, &*ret->frameLen); res != MA_SUCCESS)
+        {
+            error = std::format("Failed to get track length in PCM frames, with error code {}.", _as(int, res));
+            return nullptr;
+        }
+        if (ma_result res = ma_sound_get_length_in_seconds(&ret->sound, &ret->audioLen); res != MA_SUCCESS)
+        {
+            error = std::format("Failed to get track length in seconds, with error code {}.", _as(int, res));
+            return nullptr;
+        }
+        ret->name = track.name;
+        ret->file = file;
+
+        ma_format format = ma_format_unknown;
+        ma_uint32 channels = 0;
+        ma_uint32 sampleRate = 0;
+        if (ma_result res = ma_sound_get_data_format(&ret->sound, &format, &channels, &sampleRate, nullptr, 0); res != MA_SUCCESS)
+        {
+            error = std::format("Failed to get track format, with error code {}.", _as(int, res));
+            return nullptr;
+        }
+        ret->streamed = stream;
+        const size_t frameBytes = ma_get_bytes_per_frame(format, channels);
+        ret->residentBytes = stream ? 2 * (MA_RESOURCE_MANAGER_PAGE_SIZE_IN_MILLISECONDS * sampleRate / 1000) * frameBytes : _as(size_t, *ret->frameLen) * frameBytes; // NOLINT(readability-magic-numbers)
+
+        // Runs on the audio thread.
+        if (ma_result res = ma_sound_set_end_callback(&ret->sound, [](void*, ma_sound*) { Screen().Post([] { MusicPlayer::trackEnded(); }); }, nullptr); res != MA_SUCCESS)
+        {
+            error = std::format("Failed to set track end callback, with error code {}.", _as(int, res));
+            return nullptr;
+        }
+        return ret;
+    }
+    static void trackEnded()
+    {
+        // Ignore the ends of tracks since replaced.
+        _retif(, !MusicPlayer::audio || !ma_sound_at_end(&MusicPlayer::audio->sound));
+
+        if (MusicPlayer::upcoming && MusicPlayer::upcoming->scheduled && MusicPlayer::autoplay())
+        {
+            // Already playing since the frame the current track ended, so just take its place.
+            const std::shared_ptr<const PlaylistSnapshot> snapshot = MusicPlayer::currentPlaylist();
+            const sz at(std::distance(snapshot->tracks.begin(), std::ranges::find(snapshot->tracks, MusicPlayer::upcoming->file, &FoundMusic::file)));
+            MusicPlayer::currentTrack = at < snapshot->tracks.size() ? i32(at) : i32::sentinel();
+            MusicPlayer::audio = std::move(MusicPlayer::upcoming);
+            MusicPlayer::audio->scheduled = false;
+            MusicPlayer::prepareUpcoming();
+            MusicPlayer::warmAhead();
+            RenderScheduler::request();
+            return;
+        }
+
+        if (MusicPlayer::autoplay())
+        {
+            if (!MusicPlayer::next()) [[unlikely]]
+            {
+                CommandInvocation::println("[log.error] Failed to play next track.");
+                MusicPlayer::isPlaying.store(false);
+            }
+
+            MusicPlayer::isPlaying.store(MusicPlayer::autoplay());
+        }
+        else
+            MusicPlayer::isPlaying.store(false);
+    }
+
+    /// @brief Index in `snapshot` of the track `next` would play.
+    [[nodiscard]] static sz nextIndex(const PlaylistSnapshot& snapshot)
+    {
+        _retif(0_uz, MusicPlayer::currentTrack < 0_i32 || MusicPlayer::currentTrack + 1_i32 >= snapshot.tracks.size());
+        return sz(MusicPlayer::currentTrack + 1_i32);
+    }
+    /// @brief Decode the next `Config::PcmCacheWarmAhead` playlist entries into the PCM cache in the background, skipping those that would be streamed.
+    static void warmAhead()
+    {
+        const std::shared_ptr<const PlaylistSnapshot> snapshot = MusicPlayer::currentPlaylist();
+        std::vector<std::filesystem::path> files;
+        sz at = MusicPlayer::nextIndex(*snapshot);
+        for (size_t i = 0; i < std::min(Config::PcmCacheWarmAhead, snapshot->tracks.size()); i++, at = at + 1_uz < snapshot->tracks.size() ? at + 1_uz : 0_uz)
+            if (const FoundMusic& track = snapshot->tracks[*at]; !MusicPlayer::streams(track, 0))
+                files.emplace_back(track.file);
+        MusicPlayer::pcmCache().warm(std::move(files));
+    }
+    /// @brief Stop `upcoming` from starting as the current track ends, keeping it open.
+    static void unscheduleUpcoming()
+    {
+        _retif(, !MusicPlayer::upcoming || !MusicPlayer::upcoming->scheduled);
+        (void)ma_sound_stop(&MusicPlayer::upcoming->sound);
+        (void)ma_sound_seek_to_pcm_frame(&MusicPlayer::upcoming->sound, 0);
+        MusicPlayer::upcoming->scheduled = false;
+    }
+    /// @brief Within `Config::GaplessPrerollSeconds` of the end of the current track, open the next one and set it to start on the frame the current one ends.
+    /// @note Any earlier, arms `prerollTimer` to come back then instead.
+    static void prepareUpcoming()
+    {
+        MusicPlayer::prerollTimer.cancel();
+        if (!MusicPlayer::audio || !MusicPlayer::playing() || !MusicPlayer::autoplay())
+        {
+            MusicPlayer::unscheduleUpcoming();
+            return;
+        }
+
+        Audio& aud = *MusicPlayer::audio;
+        if (const float early = aud.audioLen - MusicPlayer::currentTime() - Config::GaplessPrerollSeconds; early > 0.0f)
+        {
+            MusicPlayer::prerollTimer = Scheduler::after(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(early)),
+                                                         [] { Screen().Post([] { MusicPlayer::prepareUpcoming(); }); });
+            return;
+        }
+
+        const std::shared_ptr<const PlaylistSnapshot> snapshot = MusicPlayer::currentPlaylist();
+        _retif(, snapshot->tracks.empty());
+        const FoundMusic& track = snapshot->tracks[*MusicPlayer::nextIndex(*snapshot)];
+        _retif(, track.file == MusicPlayer::upcomingFailed);
+        if (MusicPlayer::upcoming && MusicPlayer::upcoming->file != track.file)
+            MusicPlayer::upcoming = nullptr;
+        if (!MusicPlayer::upcoming)
+        {
+            if (MusicPlayer::upcomingLoading != track.file)
+            {
+                MusicPlayer::upcomingLoading = track.file;
+                {
+                    const std::unique_lock guard(MusicPlayer::loadLock);
+                    MusicPlayer::pendingUpcoming = Load { .generation = MusicPlayer::loadGeneration.load(),
+                                                          .track = track,
+                                                          .stream = MusicPlayer::streams(track, aud.streamed ? 0 : aud.residentBytes),
+                                                          .upcoming = true };
+                }
+                MusicPlayer::loadCv.notify_one();
+            }
+            return; // Back once it's open.
+        }
+        _retif(, MusicPlayer::upcoming->scheduled);
+
+        ma_engine& engine = MusicPlayer::audioEngine();
+        ma_uint32 sampleRate = 0;
+        if (ma_result res = ma_sound_get_data_format(&aud.sound, nullptr, nullptr, &sampleRate, nullptr, 0); res != MA_SUCCESS || sampleRate == 0)
+            return;
+
+        // The cursor and the engine clock both move once per period, so read the clock between two equal cursors to have them agree.
+        ma_uint64 cursor = 0;
+        ma_uint64 now = 0;
+        for (ma_uint64 check = 1; check != cursor;)
+        {
+            _retif(, ma_sound_get_cursor_in_pcm_frames(&aud.sound, &cursor) != MA_SUCCESS);
+            now = ma_engine_get_time_in_pcm_frames(&engine);
+            _retif(, ma_sound_get_cursor_in_pcm_frames(&aud.sound, &check) != MA_SUCCESS);
+        }
+        const ma_uint64 remaining = *aud.frameLen > cursor ? *aud.frameLen - cursor : 0;
+
+        Audio& ahead = *MusicPlayer::upcoming;
+        ma_sound_set_start_time_in_pcm_frames(&ahead.sound, now + remaining * ma_engine_get_sample_rate(&engine) / sampleRate);
+        if (ma_result res = ma_sound_start(&ahead.sound); res != MA_SUCCESS)
+        {
+            debugLog("[log.warn] Failed to schedule next track for gapless playback, with error code {}.", _as(int, res));
+            return;
+        }
+        ahead.scheduled = true;
+    }
 public:
     MusicPlayer() = delete;
 
@@ -123,6 +670,26 @@ public:
 
     /// @brief Checks if there is music loaded.
     [[nodiscard]] static bool loaded() { return MusicPlayer::hasAudio.load(); }
+    /// @brief Checks if there is music loaded, or being opened in the background to play.
+    [[nodiscard]] static bool loadedOrLoading() { return MusicPlayer::loaded() || !MusicPlayer::loadingName.empty(); }
+    struct TrackMemory
+    {
+        std::string_view name;
+        bool streamed;
+        size_t bytes;
+    };
+    /// @brief PCM held in memory by the current track, and the next one if it's been opened ahead of time.
+    [[nodiscard]] static std::vector<TrackMemory> trackMemory()
+    {
+        std::vector<TrackMemory> ret;
+        for (const std::unique_ptr<Audio>* aud : { &MusicPlayer::audio, &MusicPlayer::upcoming })
+            if (*aud)
+                ret.emplace_back(TrackMemory { .name = (*aud)->name, .streamed = (*aud)->streamed, .bytes = (*aud)->residentBytes });
+        return ret;
+    }
+    [[nodiscard]] static PcmCache::Stats pcmCacheStats() { return MusicPlayer::pcmCache().stats(); }
+    /// @brief Name of the track being opened in the background to play next, empty if none.
+    [[nodiscard]] static std::string_view loadingTrack() { return MusicPlayer::loadingName; }
 
     /// @brief Checks if music is currently playing.
     /// @note Thread-safe.
@@ -134,80 +701,112 @@ public:
     /// @note Thread-safe.
     static void autoplay(bool value) { MusicPlayer::shouldAutoplay.store(value); }
 
-    static sys::result<FoundMusic> musicLookup(std::string_view name)
+    /// @brief Walk `Config::MusicDirectory` again, and persist the result to the library catalog.
+    /// @return Whether the music directory exists.
+    static bool rescanLibrary()
     {
         namespace fs = std::filesystem;
 
-        std::error_code ec; // NOLINT(misc-const-correctness) TODO(halloimdragon): Use this everywhere.
-        const std::u32string compare = u32stringToLower(u32stringFrom(name));
-
-        if (!fs::exists("music/", ec))
-            return nullptr;
-        if (ec)
+        std::error_code ec;
+        MusicPlayer::libraryLoaded = true;
+        if (!fs::exists(Config::MusicDirectory, ec) || ec)
         {
-            CommandInvocation::println("[log.error] Failed to check if music directory exists, with error code {}.", ec.value());
-            return nullptr;
+            if (ec)
+                CommandInvocation::println("[log.error] Failed to check if music directory exists, with error code {}.", ec.value());
+            MusicPlayer::library.clear();
+            MusicPlayer::libraryDirs.clear();
+            MusicPlayer::libraryChanged();
+            MusicPlayer::libraryWatcher().stop();
+            return false;
         }
 
-        const auto tryFindWithCompare = [&](auto&& pred) -> sys::result<FoundMusic>
-        {
-            for (const auto& dir : fs::recursive_directory_iterator("music/", fs::directory_options::skip_permission_denied, ec))
-            {
-                if (dir.is_regular_file(ec))
-                {
-                    if (pred(dir.path().stem().generic_u32string()))
-                        return FoundMusic { .name = stringFrom(dir.path().stem().generic_u8string()), .file = dir.path() };
-                }
-                if (ec)
-                {
-                    CommandInvocation::println("[log.error] Failed to iterate through music directory, with error code {}.", ec.value());
-                    return nullptr;
-                }
-            }
-
-            return nullptr;
-        };
+        LibrarySnapshot snapshot = LibraryScanner::scan(Config::MusicDirectory);
+        (void)LibraryCatalog::save(Config::LibraryCatalogFile, snapshot);
+        MusicPlayer::library = std::move(snapshot.tracks);
+        MusicPlayer::libraryDirs = std::move(snapshot.dirs);
+        MusicPlayer::watchLibrary();
+        MusicPlayer::libraryChanged();
+        return true;
+    }
 
-        sys::result<FoundMusic> res = tryFindWithCompare([&](std::u32string_view trackName) { return u32stringToLower(trackName) == compare; });
-        _retif(res.move(), res);
-        res = tryFindWithCompare([&](std::u32string_view trackName) { return u32stringToLower(trackName).starts_with(compare); });
-        _retif(res.move(), res);
-        res = tryFindWithCompare([&](std::u32string_view trackName) { return u32stringToLower(trackName).contains(compare); });
-        _retif(res.move(), res);
+    /// @brief Find the track best matching `words`, as if joined by single spaces.
+    static sys::result<FoundMusic> musicLookup(std::span<const std::string_view> words)
+    {
+        MusicPlayer::ensureLibrary();
 
-        return nullptr;
+        sys::result<sz> found = MusicPlayer::searchIndex.find(lookupKeyFrom(words));
+        _retif(nullptr, !found);
+        return MusicPlayer::library[*found.move()];
     }
 
     static inline i32 currentTrack = i32::sentinel();
-    [[nodiscard]] static const std::vector<FoundMusic>& currentPlaylist() { return MusicPlayer::playlist; }
-
-    static bool generateShuffledPlaylist()
+    /// @brief The current version of the playlist, which stays valid and unchanged for as long as it's held.
+    /// @note Thread-safe.
+    [[nodiscard]] static std::shared_ptr<const PlaylistSnapshot> currentPlaylist() { return MusicPlayer::playlist.load(); }
+    [[nodiscard]] static const std::vector<FoundMusic>& currentLibrary()
     {
-        namespace fs = std::filesystem;
-        std::error_code ec;
+        MusicPlayer::ensureLibrary();
+        return MusicPlayer::library;
+    }
 
-        MusicPlayer::playlist.clear();
-        for (const auto& dir : fs::recursive_directory_iterator("music/", fs::directory_options::skip_permission_denied, ec))
-            if (dir.is_regular_file(ec))
-                MusicPlayer::playlist.emplace_back(FoundMusic { .name = stringFrom(dir.path().stem().generic_u8string()), .file = dir.path() });
+    /// @brief The current version of the tag index, which stays valid and unchanged for as long as it's held.
+    /// @note Thread-safe.
+    [[nodiscard]] static std::shared_ptr<const TagIndex> tags() { return MusicPlayer::tagIndex.load(); }
+    [[nodiscard]] static const std::set<Tag>& currentTagFilter() { return MusicPlayer::tagFilter; }
+    /// @brief Restrict the playlist to tracks matching `filter`, and reshuffle it.
+    static bool setTagFilter(std::set<Tag> filter)
+    {
+        MusicPlayer::tagFilter = std::move(filter);
+        MusicPlayer::currentTrack = i32::sentinel();
+        return MusicPlayer::generateShuffledPlaylist();
+    }
 
-        if (ec)
-            CommandInvocation::println("[log.warn] Couldn't fully iterate through music directory, got error code {}.", ec.value());
+    static bool generateShuffledPlaylist()
+    {
+        MusicPlayer::ensureLibrary();
+        MusicPlayer::untaggedAdditions.clear(); // Shuffled in below, if they match by now.
+        std::vector<FoundMusic> tracks;
+        if (MusicPlayer::tagFilter.empty())
+            tracks = MusicPlayer::library;
+        else
+        {
+            // The index may lag behind the library, so its matches are looked up there, dropping any since removed.
+            const std::shared_ptr<const TagIndex> tags = MusicPlayer::tags();
+            const std::vector<std::uint32_t> matches = tags->filter(MusicPlayer::tagFilter);
+            tracks.reserve(matches.size());
+            for (const std::uint32_t i : matches)
+            {
+                const std::filesystem::path& file = tags->library()[i].file;
+                if (const auto it = std::ranges::lower_bound(MusicPlayer::library, file, {}, &FoundMusic::file); it != MusicPlayer::library.end() && it->file == file)
+                    tracks.emplace_back(*it);
+            }
+        }
 
-        if (MusicPlayer::playlist.empty())
+        if (tracks.empty())
         {
-            CommandInvocation::println("[log.warn] Couldn't find any tracks to play! (Did you add any under `music/`?)");
+            MusicPlayer::publishPlaylist({});
+            if (MusicPlayer::tagFilter.empty())
+                CommandInvocation::println("[log.warn] Couldn't find any tracks to play! (Did you add any under `music/`?)");
+            else
+                CommandInvocation::println("[log.warn] No tracks match the selected tags.");
             return false;
         }
 
-        std::shuffle(MusicPlayer::playlist.begin(), MusicPlayer::playlist.end(), MusicPlayer::randEngine);
-        std::shuffle(MusicPlayer::playlist.begin(), MusicPlayer::playlist.end(), MusicPlayer::randEngine); // Again for good measure.:
+        std::shuffle(tracks.begin(), tracks.end(), MusicPlayer::randEngine);
+        std::shuffle(tracks.begin(), tracks.end(), MusicPlayer::randEngine); // Again for good measure.:
+        MusicPlayer::publishPlaylist(std::move(tracks));
         return true;
     }
 
     [[nodiscard]] static bool resume()
     {
-        _retif(false, !MusicPlayer::audio);
+        if (!MusicPlayer::audio)
+        {
+            // Still being opened, so just have it start once it is.
+            _retif(false, MusicPlayer::loadingName.empty());
+            MusicPlayer::isPlaying = true;
+            return true;
+        }
 
         Audio& aud = *MusicPlayer::audio;
         if (ma_result res = ma_sound_start(&aud.sound); res != MA_SUCCESS)
@@ -217,11 +816,19 @@ public:
         }
 
         MusicPlayer::isPlaying = true;
+        if constexpr (Config::GaplessPlayback)
+            MusicPlayer::prepareUpcoming();
         return true;
     }
     [[nodiscard]] static bool pause()
     {
-        _retif(false, !MusicPlayer::audio);
+        if (!MusicPlayer::audio)
+        {
+            // Still being opened, so just have it stay paused once it is.
+            _retif(false, MusicPlayer::loadingName.empty());
+            MusicPlayer::isPlaying = false;
+            return true;
+        }
 
         Audio& aud = *MusicPlayer::audio;
         if (ma_result res = ma_sound_stop(&aud.sound); res != MA_SUCCESS)
@@ -229,6 +836,8 @@ public:
             CommandInvocation::println("[log.error] Failed to pause track, with error code {}.", _as(int, res));
             return false;
         }
+        MusicPlayer::unscheduleUpcoming();
+        MusicPlayer::prerollTimer.cancel();
 
         MusicPlayer::isPlaying = false;
         return true;
@@ -250,6 +859,9 @@ public:
             CommandInvocation::println("[log.error] Failed to seek track, with error code {}.", _as(int, res));
             return false;
         }
+        MusicPlayer::unscheduleUpcoming();
+        if constexpr (Config::GaplessPlayback)
+            MusicPlayer::prepareUpcoming(); // Against the new position.
 
         return true;
     }
@@ -264,102 +876,58 @@ public:
         return true;
     }
 
-    [[nodiscard]] static bool startMusic(std::string foundMusicName, const std::filesystem::path& foundMusicFile)
+    /// @brief Start opening a track on the loader thread, superseding any load still in flight, to play (or stay paused) once it's open.
+    /// @return Whether the load was queued. Failures to open the track are reported once it's been tried.
+    [[nodiscard]] static bool startMusic(const FoundMusic& track)
     {
-        namespace fs = std::filesystem;
-
-        if (!MusicPlayer::audio)
-        {
-            MusicPlayer::audio = Audio();
-            MusicPlayer::hasAudio = true;
-        }
-
-        Audio& aud = *MusicPlayer::audio;
-        sys::optional_destructor aud_dtor = [] noexcept
-        {
-            MusicPlayer::audio = std::nullopt;
-            MusicPlayer::hasAudio = false;
-        };
-
-#if _libcxxext_os_windows
-        if (const ma_result res = ma_sound_init_from_file_w(&MusicPlayer::audioEngine(), foundMusicFile.c_str(), MA_SOUND_FLAG_NO_SPATIALIZATION, nullptr, nullptr, &aud.sound);
-#else
-        if (const ma_result res =
-                ma_sound_init_from_file(&MusicPlayer::audioEngine(), foundMusicFile.string().c_str(), MA_SOUND_FLAG_NO_SPATIALIZATION, nullptr, nullptr, &aud.sound);
-#endif
-            res != MA_SUCCESS)
-        {
-            CommandInvocation::println("[log.error] Failed to load track `{}`, with error code {}.", stringFrom(fs::path(foundMusicFile).generic_u8string()), _as(int, res));
-            return false;
-        }
-        sys::optional_destructor sound_dtor = [] noexcept { ma_sound_uninit(&MusicPlayer::audio->sound); };
-
-        if (ma_result res = ma_sound_get_length_in_pcm_frames(&aud.sound, &*aud.frameLen); res != MA_SUCCESS)
-        {
-            CommandInvocation::println("[log.error] Failed to get track length in PCM frames, with error code {}.", _as(int, res));
-            return false;
-        }
-        if (ma_result res = ma_sound_get_length_in_seconds(&aud.sound, &aud.audioLen); res != MA_SUCCESS)
-        {
-            CommandInvocation::println("[log.error] Failed to get track length in seconds, with error code {}.", _as(int, res));
-            return false;
-        }
-        aud.name = std::move(foundMusicName);
-
-        if (ma_result res = ma_sound_set_end_callback(&aud.sound,
-                                                      [](void*, ma_sound*)
-        {
-            if (MusicPlayer::autoplay())
-                Screen().Post([]
-                {
-                    if (!MusicPlayer::next()) [[unlikely]]
-                    {
-                        CommandInvocation::println("[log.error] Failed to play next track.");
-                        MusicPlayer::isPlaying.store(false);
-                    }
-
-                    MusicPlayer::isPlaying.store(MusicPlayer::autoplay());
-                });
-            else
-                Screen().Post([] { MusicPlayer::isPlaying.store(false); });
-        }, nullptr);
-            res != MA_SUCCESS)
-        {
-            CommandInvocation::println("[log.error] Failed to set track end callback, with error code {}.", _as(int, res));
-            return false;
-        }
+        (void)MusicPlayer::loader();
 
-        if (MusicPlayer::isPlaying.load() && !MusicPlayer::resume())
+        MusicPlayer::loadingName = track.name;
+        MusicPlayer::upcomingLoading.clear();
+        const bool stream = MusicPlayer::streams(track, 0);
         {
-            CommandInvocation::println("[log.error] Failed to resume track.");
-            return false;
+            const std::unique_lock guard(MusicPlayer::loadLock);
+            MusicPlayer::pendingLoad = Load { .generation = ++MusicPlayer::loadGeneration, .track = track, .stream = stream, .upcoming = false };
+            MusicPlayer::pendingUpcoming.reset();
         }
-
-        sound_dtor.release();
-        aud_dtor.release();
+        MusicPlayer::loadCv.notify_one();
+        RenderScheduler::request();
         return true;
     }
-    [[nodiscard]] static bool queryStartMusic(std::string_view query)
+    [[nodiscard]] static bool queryStartMusic(std::span<const std::string_view> words)
     {
-        sys::result<FoundMusic> foundRes = MusicPlayer::musicLookup(query);
+        sys::result<FoundMusic> foundRes = MusicPlayer::musicLookup(words);
         _retif(false, !foundRes);
 
         const FoundMusic found = foundRes.move();
-        const sz foundIndex(std::distance(MusicPlayer::playlist.begin(), std::ranges::find(MusicPlayer::playlist, found)));
-        MusicPlayer::currentTrack = foundIndex < MusicPlayer::playlist.size() ? i32(foundIndex) : i32::sentinel();
-        return MusicPlayer::startMusic(found.name, found.file);
+        const std::shared_ptr<const PlaylistSnapshot> snapshot = MusicPlayer::currentPlaylist();
+        const sz foundIndex(std::distance(snapshot->tracks.begin(), std::ranges::find(snapshot->tracks, found)));
+        MusicPlayer::currentTrack = foundIndex < snapshot->tracks.size() ? i32(foundIndex) : i32::sentinel();
+        return MusicPlayer::startMusic(found);
     }
     [[nodiscard]] static bool stopMusic()
     {
+        {
+            const std::unique_lock guard(MusicPlayer::loadLock);
+            ++MusicPlayer::loadGeneration; // Drops any load in flight once it finishes.
+            MusicPlayer::pendingLoad.reset();
+            MusicPlayer::pendingUpcoming.reset();
+            MusicPlayer::loadedAudio.reset();
+            MusicPlayer::loadedUpcoming.reset();
+        }
+        MusicPlayer::loadingName.clear();
+        MusicPlayer::upcomingLoading.clear();
+        MusicPlayer::prerollTimer.cancel();
         _retif(true, !MusicPlayer::audio);
 
         Audio& aud = *MusicPlayer::audio;
         if (ma_result res = ma_sound_stop(&aud.sound); res != MA_SUCCESS) [[unlikely]]
             CommandInvocation::println("[log.warn] Couldn't stop track, with error code {}.", _as(int, res));
 
-        ma_sound_uninit(&aud.sound);
-        MusicPlayer::audio = std::nullopt;
+        MusicPlayer::audio = nullptr;
         MusicPlayer::hasAudio = false;
+        MusicPlayer::upcoming = nullptr;
+        MusicPlayer::upcomingFailed.clear();
 
         return true;
     }
@@ -368,23 +936,30 @@ public:
     {
         _retif(false, !MusicPlayer::stopMusic());
 
-        if (MusicPlayer::currentTrack < 0_i32 || MusicPlayer::currentTrack >= MusicPlayer::playlist.size())
+        std::shared_ptr<const PlaylistSnapshot> snapshot = MusicPlayer::currentPlaylist();
+        if (MusicPlayer::currentTrack < 0_i32 || MusicPlayer::currentTrack >= snapshot->tracks.size())
         {
             MusicPlayer::currentTrack = 0_i32;
-            _retif(false, MusicPlayer::currentTrack >= MusicPlayer::playlist.size() && !MusicPlayer::generateShuffledPlaylist());
+            if (MusicPlayer::currentTrack >= snapshot->tracks.size())
+            {
+                _retif(false, !MusicPlayer::generateShuffledPlaylist());
+                snapshot = MusicPlayer::currentPlaylist();
+            }
         }
 
-        Screen().PostEvent(ui::Event::Custom);
+        RenderScheduler::request();
 
-        return MusicPlayer::startMusic(MusicPlayer::playlist[sz(MusicPlayer::currentTrack)].name, MusicPlayer::playlist[sz(MusicPlayer::currentTrack)].file);
+        const FoundMusic& track = snapshot->tracks[sz(MusicPlayer::currentTrack)];
+        return MusicPlayer::startMusic(track);
     }
     [[nodiscard]] static bool next()
     {
-        if (MusicPlayer::loaded())
+        // Past whatever's queued, even if it's yet to finish loading.
+        if (MusicPlayer::loadedOrLoading())
         {
             _retif(false, !MusicPlayer::stopMusic());
 
-            if (MusicPlayer::currentTrack >= MusicPlayer::playlist.size())
+            if (MusicPlayer::currentTrack >= MusicPlayer::currentPlaylist()->tracks.size())
                 MusicPlayer::currentTrack = 0_i32;
             else
                 ++MusicPlayer::currentTrack;
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <Preamble.h>
+
+#include <CompilerWarnings.h>
+_push_nowarn_c_cast();
+#include <condition_variable>
+#include <filesystem>
+#include <list>
+#include <miniaudio.h>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+_pop_nowarn_c_cast();
+
+#include <module/sys>
+
+#include <Debug.h>
+#include <Trace.h>
+#include <Utility.h>
+
+/// @brief Decoded tracks kept in memory after they're played, or before, up to a byte budget, dropping the least recently used first.
+/// @note
+/// Each entry holds a reference on the resource manager's decoded buffer for its file, so a sound opened on the same file with `MA_SOUND_FLAG_DECODE` shares it
+/// rather than decoding it again. Evicting an entry only drops that reference, so a track still playing keeps its buffer until it's done with it. Tracks can
+/// be warmed ahead of time on the cache's own thread.
+class PcmCache
+{
+    struct Entry
+    {
+        std::filesystem::path file;
+        ma_resource_manager_data_source source {};
+        bool open = false; // Whether `source` was initialized.
+        size_t bytes = 0;
+
+        Entry() = default;
+        Entry(const Entry&) = delete;
+        Entry(Entry&&) = delete;
+        ~Entry()
+        {
+            if (this->open)
+                ma_resource_manager_data_source_uninit(&this->source);
+        }
+
+        Entry& operator=(const Entry&) = delete;
+        Entry& operator=(Entry&&) = delete;
+    };
+
+    ma_resource_manager* manager;
+    size_t budget;
+
+    std::mutex lock;
+    std::list<Entry> entries; // Most recently used first.
+    std::unordered_map<std::filesystem::path, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+
+    std::vector<std::filesystem::path> warmQueue; // Soonest needed first.
+    std::condition_variable_any warmCv;
+    std::jthread warmer; // Last, so it's joined before the entries are dropped.
+
+    /// @note Call with `lock` held.
+    void evict()
+    {
+        // The newest entry is always kept, even over budget, since it was just asked for.
+        while (this->bytes > this->budget && this->entries.size() > 1)
+        {
+            this->bytes -= this->entries.back().bytes;
+            this->index.erase(this->entries.back().file);
+            this->entries.pop_back();
+        }
+    }
+    void run(const std::stop_token& token)
+    {
+        _trace_thread("pcm warmer");
+        while (true)
+        {
+            std::filesystem::path file;
+            {
+                std::unique_lock guard(this->lock);
+                _retif(, !this->warmCv.wait(guard, token, [&] { return !this->warmQueue.empty(); }));
+                file = std::move(this->warmQueue.front());
+                this->warmQueue.erase(this->warmQueue.begin());
+            }
+
+            _trace_scope("pcm warm");
+            (void)this->retain(file);
+        }
+    }
+public:
+    struct Stats
+    {
+        size_t tracks;
+        size_t bytes;
+        size_t budget;
+        size_t hits;
+        size_t misses;
+    };
+
+    /// @param manager The resource manager sounds are opened through.
+    /// @param budget How many bytes of decoded PCM to keep.
+    PcmCache(ma_resource_manager* manager, size_t budget) : manager(manager), budget(budget)
+    {
+        this->warmer = std::jthread([this](const std::stop_token& token) { this->run(token); });
+    }
+
+    PcmCache(const PcmCache&) = delete;
+    PcmCache(PcmCache&&) = delete;
+    ~PcmCache() = default;
+
+    PcmCache& operator=(const PcmCache&) = delete;
+    PcmCache& operator=(PcmCache&&) = delete;
+
+    /// @brief Mark `file` as just used, and count whether it was kept.
+    /// @return Whether it was kept, so opening it won't decode it again.
+    bool touch(const std::filesystem::path& file)
+    {
+        const std::unique_lock guard(this->lock);
+        const auto it = this->index.find(file);
+        if (it == this->index.end())
+        {
+            ++this->misses;
+            return false;
+        }
+
+        ++this->hits;
+        this->entries.splice(this->entries.begin(), this->entries, it->second);
+        return true;
+    }
+    /// @brief Decode `file` and keep it, or only mark it as just used if it's already kept.
+    /// @return Whether it's kept.
+    /// @note Blocks for as long as decoding takes, unless another sound already holds the file decoded.
+    bool retain(const std::filesystem::path& file)
+    {
+        {
+            const std::unique_lock guard(this->lock);
+            if (const auto it = this->index.find(file); it != this->index.end())
+            {
+                this->entries.splice(this->entries.begin(), this->entries, it->second);
+                return true;
+            }
+        }
+
+        std::list<Entry> fresh(1);
+        Entry& entry = fresh.front();
+        entry.file = file;
+#if _libcxxext_os_windows
+        if (const ma_result res = ma_resource_manager_data_source_init_w(this->manager, file.c_str(), MA_RESOURCE_MANAGER_DATA_SOURCE_FLAG_DECODE, nullptr, &entry.source);
+#else
+        if (const ma_result res = ma_resource_manager_data_source_init(this->manager, file.string().c_str(), MA_RESOURCE_MANAGER_DATA_SOURCE_FLAG_DECODE, nullptr, &entry.source);
+#endif
+            res != MA_SUCCESS)
+        {
+            debugLog("[log.warn] Failed to decode `{}` into the PCM cache, with error code {}.", pathToString(file), _as(int, res));
+            return false;
+        }
+        entry.open = true;
+
+        ma_uint64 frames = 0;
+        ma_format format = ma_format_unknown;
+        ma_uint32 channels = 0;
+        if (ma_resource_manager_data_source_get_length_in_pcm_frames(&entry.source, &frames) != MA_SUCCESS ||
+            ma_resource_manager_data_source_get_data_format(&entry.source, &format, &channels, nullptr, nullptr, 0) != MA_SUCCESS)
+            return false;
+        entry.bytes = _as(size_t, frames) * ma_get_bytes_per_frame(format, channels);
+
+        const std::unique_lock guard(this->lock);
+        _retif(true, this->index.contains(file)); // Raced with another thread keeping it, so `fresh` is just dropped.
+        this->bytes += entry.bytes;
+        this->entries.splice(this->entries.begin(), fresh);
+        this->index.insert_or_assign(file, this->entries.begin());
+        this->evict();
+        return true;
+    }
+    /// @brief Decode `files` on the cache's thread, soonest needed first, in place of whatever was still waiting to be warmed.
+    void warm(std::vector<std::filesystem::path> files)
+    {
+        {
+            const std::unique_lock guard(this->lock);
+            this->warmQueue = std::move(files);
+        }
+        this->warmCv.notify_one();
+    }
+
+    [[nodiscard]] Stats stats()
+    {
+        const std::unique_lock guard(this->lock);
+        return Stats { .tracks = this->entries.size(), .bytes = this->bytes, .budget = this->budget, .hits = this->hits, .misses = this->misses };
+    }
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Preamble.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+
+#include <module/sys>
+
+#include <Config.h>
+#include <Scheduler.h>
+#include <Screen.h>
+
+/// @brief Paces redraws asked for from other threads.
+/// @note
+/// Requests made while one is already outstanding are folded into it, and one made sooner than `Config::FrameInterval` after the last frame is held back
+/// until then, so bursts of background updates cost at most one frame per interval. Sources that redraw periodically can also check whether anything they
+/// show actually changed first, with `RenderScheduler::changed`. Counters are kept for the `frames` command.
+class RenderScheduler
+{
+    using Clock = std::chrono::steady_clock;
+
+    static inline std::atomic<bool> pending = false;
+    static inline std::atomic<Clock::rep> lastFrame = 0; // Since the clock's epoch.
+
+    static inline std::atomic<size_t> requested = 0;
+    static inline std::atomic<size_t> coalesced = 0;
+    static inline std::atomic<size_t> unchanged = 0;
+    static inline std::atomic<size_t> rendered = 0;
+
+    static void post() noexcept { Screen().PostEvent(ui::Event::Custom); }
+public:
+    struct Counters
+    {
+        size_t requested;
+        size_t coalesced; // Folded into an outstanding request.
+        size_t unchanged; // Not requested, since nothing visible changed.
+        size_t rendered;  // By any cause, including input.
+    };
+
+    RenderScheduler() = delete;
+
+    /// @brief Ask for a redraw, on or before the next frame slot.
+    /// @note Thread-safe.
+    static void request() noexcept
+    {
+        ++RenderScheduler::requested;
+        if (RenderScheduler::pending.exchange(true))
+        {
+            ++RenderScheduler::coalesced;
+            return;
+        }
+
+        const Clock::time_point now = Clock::now();
+        const Clock::time_point due = Clock::time_point(Clock::duration(RenderScheduler::lastFrame.load())) + Config::FrameInterval;
+        if (due <= now)
+        {
+            RenderScheduler::post();
+            return;
+        }
+
+        try
+        {
+            Scheduler::after(due - now, [] { RenderScheduler::post(); }).detach();
+        }
+        catch (const std::exception&)
+        {
+            RenderScheduler::post(); // Rather early than never.
+        }
+    }
+    /// @brief Ask for a redraw if `key`, standing for what a periodic source would show, differs from `shown`, what it showed last.
+    /// @note Thread-safe.
+    static void requestIfChanged(const std::atomic<std::uint64_t>& shown, std::uint64_t key) noexcept
+    {
+        if (shown.load() == key)
+        {
+            ++RenderScheduler::unchanged;
+            return;
+        }
+        RenderScheduler::request();
+    }
+
+    /// @brief Note that a frame was drawn, from the root renderer.
+    static void frameRendered()
+    {
+        ++RenderScheduler::rendered;
+        RenderScheduler::lastFrame = Clock::now().time_since_epoch().count();
+        RenderScheduler::pending = false;
+    }
+
+    [[nodiscard]] static Counters counters()
+    {
+        return Counters {
+            .requested = RenderScheduler::requested.load(),
+            .coalesced = RenderScheduler::coalesced.load(),
+            .unchanged = RenderScheduler::unchanged.load(),
+            .rendered = RenderScheduler::rendered.load(),
+        };
+    }
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <Catalog.h>
+#include <Config.h>
+#include <Exec.inl>
+#include <Trace.h>
+#include <Utility.h>
+#include <WorkPool.h>
+
+/// @brief Parallel music library scanner.
+/// @note
+/// Directory traversal fans out over a `WorkStealingPool`, one task per directory, so slow `readdir`/`stat` round-trips on network or spinning storage overlap.
+/// Every worker accumulates into its own shard; shards are merged and sorted afterwards, so the result doesn't depend on scheduling.
+class LibraryScanner
+{
+    struct Shard
+    {
+        std::vector<LibraryTrack> tracks;
+        std::vector<LibraryDirectory> dirs;
+        sz errors = 0_uz;
+    };
+
+    static void scanDirectory(WorkStealingPool& pool, std::vector<Shard>& shards, sz worker, const std::filesystem::path& dir)
+    {
+        namespace fs = std::filesystem;
+        _trace_scope("scan directory");
+        std::error_code ec;
+
+        Shard& shard = shards[*worker];
+        shard.dirs.emplace_back(LibraryDirectory { .dir = dir, .mtime = LibraryCatalog::mtimeOf(dir) });
+
+        for (fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::error_code entryEc;
+            const fs::directory_entry& entry = *it;
+            if (entry.is_directory(entryEc))
+            {
+                // Directory symlinks aren't followed, like `recursive_directory_iterator`, so loops terminate and nothing is indexed twice.
+                if (entry.is_symlink(entryEc))
+                    continue;
+
+                pool.submit([&shards, sub = entry.path()](WorkStealingPool& subPool, sz subWorker) { LibraryScanner::scanDirectory(subPool, shards, subWorker, sub); });
+                continue;
+            }
+            if (!entry.is_regular_file(entryEc))
+                continue;
+
+            // A size that couldn't be read is recorded as unknown, rather than as `uintmax_t(-1)`.
+            const std::uintmax_t size = entry.file_size(entryEc);
+            std::string name = stringFrom(entry.path().stem().generic_u8string());
+            std::string key = lookupKeyFrom(name);
+            shard.tracks.emplace_back(LibraryTrack { .name = std::move(name),
+                                                     .file = entry.path(),
+                                                     .key = std::move(key),
+                                                     .mtime = LibraryCatalog::mtimeOf(entry.path()),
+                                                     .size = u64(entryEc ? std::uint64_t(0) : _as(std::uint64_t, size)) });
+        }
+
+        if (ec)
+            ++shard.errors;
+    }
+public:
+    LibraryScanner() = delete;
+
+    /// @brief Walk `root` and collect every regular file beneath it.
+    /// @param threadCount Number of scanning threads, `0` for `Config::LibraryScanThreads`.
+    /// @param messages Where to collect what would be printed to the console, to be printed on the UI thread later, when scanning off it.
+    static LibrarySnapshot scan(const std::filesystem::path& root, sz threadCount = 0_uz, std::vector<std::string>* messages = nullptr)
+    {
+        const auto report = [&](std::string line)
+        {
+            if (messages)
+                messages->emplace_back(std::move(line));
+            else
+                CommandInvocation::println("{}", line);
+        };
+
+        _trace_scope("library scan");
+        const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+        std::vector<Shard> shards;
+        sz workers = 0_uz;
+        {
+            WorkStealingPool pool(threadCount != 0_uz ? threadCount : Config::LibraryScanThreads);
+            workers = pool.size();
+            shards.resize(*workers);
+
+            pool.submit([&shards, &root](WorkStealingPool& rootPool, sz rootWorker) { LibraryScanner::scanDirectory(rootPool, shards, rootWorker, root); });
+            pool.wait();
+        }
+
+        LibrarySnapshot ret;
+        sz trackCount = 0_uz, dirCount = 0_uz, errors = 0_uz;
+        for (const Shard& shard : shards)
+        {
+            trackCount += shard.tracks.size();
+            dirCount += shard.dirs.size();
+            errors += shard.errors;
+        }
+        ret.tracks.reserve(*trackCount);
+        ret.dirs.reserve(*dirCount);
+        for (Shard& shard : shards)
+        {
+            std::ranges::move(shard.tracks, std::back_inserter(ret.tracks));
+            std::ranges::move(shard.dirs, std::back_inserter(ret.dirs));
+        }
+        std::ranges::sort(ret.tracks, {}, &LibraryTrack::file);
+        std::ranges::sort(ret.dirs, {}, &LibraryDirectory::dir);
+
+        if (errors > 0_uz)
+            report(std::format("[log.warn] Couldn't fully iterate through {} directories in the music directory.", *errors));
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        report(std::format("[log.info] Scanned {} files in {} directories in {:.3f}s ({:.0f} files/s, {} threads).", *trackCount, *dirCount, seconds,
+                           seconds > 0.0 ? _as(double, *trackCount) / seconds : 0.0, *workers));
+
+        return ret;
+    }
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <Config.h>
+#include <Trace.h>
+
+class Timer;
+
+/// @brief One thread running every deadline and periodic tick the components register, instead of a sleeping thread each.
+/// @note
+/// Timers are kept in a hashed timer wheel of `Config::SchedulerTick` wide slots, with timers due further out than a turn of the wheel waiting in their slot
+/// for later turns. The thread sleeps until the next occupied slot, or indefinitely with no timers, so nothing wakes up unless something is due. Tasks run on
+/// the scheduler's thread, so should only post to the screen or flip state, rather than block.
+class Scheduler
+{
+    friend class Timer;
+
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t Slots = 256; // NOLINT(readability-magic-numbers)
+
+    struct Entry
+    {
+        std::uint64_t id;
+        Clock::time_point deadline;
+        Clock::duration period; // Zero for one-shot timers.
+        std::function<bool()> task;
+    };
+
+    std::array<std::vector<Entry>, Scheduler::Slots> wheel;
+    std::unordered_map<std::uint64_t, size_t> slotOf; // By timer ID.
+    std::uint64_t nextId = 1;
+    std::int64_t currentTick = 0;   // Last tick the wheel was turned to.
+    std::uint64_t running = 0;      // ID of the timer whose task is running, if any.
+    std::uint64_t changes = 0;      // Bumped whenever timers are added or removed, to wake the thread.
+    bool runningCancelled = false;
+    std::mutex lock;
+    std::condition_variable_any changedCv;
+    std::jthread thread;
+
+    static inline std::atomic<bool> tornDown = false; // Once set, timers still held have nothing left to cancel.
+
+    Scheduler()
+    {
+        this->currentTick = Scheduler::tickOf(Clock::now());
+        this->thread = std::jthread([this](const std::stop_token& token) { this->run(token); });
+    }
+
+    [[nodiscard]] static std::int64_t tickOf(Clock::time_point time) { return time.time_since_epoch() / Config::SchedulerTick; }
+    [[nodiscard]] static size_t slotFor(std::int64_t tick) { return _as(size_t, tick) % Scheduler::Slots; }
+
+    static Scheduler& instance()
+    {
+        static Scheduler ret;
+        return ret;
+    }
+
+    /// @note Expects `lock` to be held.
+    void insert(Entry entry)
+    {
+        // Never behind the wheel, or it'd wait a whole turn to be seen.
+        const size_t slot = Scheduler::slotFor(std::max(Scheduler::tickOf(entry.deadline), this->currentTick));
+        this->slotOf.insert_or_assign(entry.id, slot);
+        this->wheel[slot].emplace_back(std::move(entry));
+    }
+    /// @note Expects `lock` to be held.
+    [[nodiscard]] Clock::time_point nextDeadline() const
+    {
+        // The first occupied slot within one turn has the soonest deadlines, unless everything's further out than that.
+        for (std::int64_t tick = this->currentTick; tick < this->currentTick + _as(std::int64_t, Scheduler::Slots); tick++)
+        {
+            Clock::time_point ret = Clock::time_point::max();
+            for (const Entry& entry : this->wheel[Scheduler::slotFor(tick)])
+                if (Scheduler::tickOf(entry.deadline) <= tick)
+                    ret = std::min(ret, entry.deadline);
+            if (ret != Clock::time_point::max())
+                return ret;
+        }
+
+        Clock::time_point ret = Clock::time_point::max();
+        for (const std::vector<Entry>& slot : this->wheel)
+            for (const Entry& entry : slot)
+                ret = std::min(ret, entry.deadline);
+        return ret;
+    }
+    /// @brief Take out a timer that's due, turning the wheel up to now.
+    /// @note Expects `lock` to be held.
+    sys::result<Entry> takeDue()
+    {
+        const Clock::time_point now = Clock::now();
+        const std::int64_t nowTick = Scheduler::tickOf(now);
+
+        // A full turn covers every slot, however long it's been since the last.
+        for (std::int64_t tick = std::max(this->currentTick, nowTick - _as(std::int64_t, Scheduler::Slots) + 1); tick <= nowTick; tick++)
+        {
+            this->currentTick = tick;
+            std::vector<Entry>& slot = this->wheel[Scheduler::slotFor(tick)];
+            if (const auto it = std::ranges::find_if(slot, [&](const Entry& entry) { return entry.deadline <= now; }); it != slot.end())
+            {
+                Entry ret = std::move(*it);
+                slot.erase(it);
+                this->slotOf.erase(ret.id);
+                return ret;
+            }
+        }
+        this->currentTick = nowTick;
+        return nullptr;
+    }
+    void run(const std::stop_token& token)
+    {
+        _trace_thread("scheduler");
+        std::unique_lock guard(this->lock);
+        while (!token.stop_requested())
+        {
+            sys::result<Entry> due = this->takeDue();
+            if (!due)
+            {
+                const Clock::time_point deadline = this->nextDeadline();
+                const std::uint64_t changes = this->changes;
+                if (deadline == Clock::time_point::max())
+                    this->changedCv.wait(guard, token, [&] { return this->changes != changes; });
+                else
+                    (void)this->changedCv.wait_until(guard, token, deadline, [&] { return this->changes != changes || Clock::now() >= deadline; });
+                continue;
+            }
+
+            Entry entry = due.move();
+            this->running = entry.id;
+            this->runningCancelled = false;
+            guard.unlock();
+            const bool again = entry.task();
+            guard.lock();
+
+            this->running = 0;
+            if (again && entry.period != Clock::duration::zero() && !this->runningCancelled)
+            {
+                // Keep to the original cadence, unless it fell more than a period behind.
+                entry.deadline = std::max(entry.deadline + entry.period, Clock::now());
+                this->insert(std::move(entry));
+            }
+            this->changedCv.notify_all();
+        }
+    }
+
+    std::uint64_t schedule(Clock::duration delay, Clock::duration period, std::function<bool()> task)
+    {
+        const std::scoped_lock guard(this->lock);
+        const std::uint64_t id = this->nextId++;
+        this->insert(Entry { .id = id, .deadline = Clock::now() + delay, .period = period, .task = std::move(task) });
+        ++this->changes;
+        this->changedCv.notify_all();
+        return id;
+    }
+    void cancel(std::uint64_t id)
+    {
+        std::unique_lock guard(this->lock);
+        if (const auto it = this->slotOf.find(id); it != this->slotOf.end())
+        {
+            std::erase_if(this->wheel[it->second], [&](const Entry& entry) { return entry.id == id; });
+            this->slotOf.erase(it);
+            ++this->changes;
+            this->changedCv.notify_all();
+            return;
+        }
+
+        // Running right now, so wait it out, unless it's cancelling itself.
+        if (this->running == id)
+        {
+            this->runningCancelled = true;
+            if (std::this_thread::get_id() != this->thread.get_id())
+                this->changedCv.wait(guard, [&] { return this->running != id; });
+        }
+    }
+    [[nodiscard]] bool pending(std::uint64_t id)
+    {
+        const std::scoped_lock guard(this->lock);
+        return this->slotOf.contains(id) || this->running == id;
+    }
+public:
+    Scheduler(const Scheduler&) = delete;
+    Scheduler(Scheduler&&) = delete;
+    ~Scheduler() { Scheduler::tornDown = true; }
+
+    Scheduler& operator=(const Scheduler&) = delete;
+    Scheduler& operator=(Scheduler&&) = delete;
+
+    /// @brief Run `task` once, after `delay`.
+    [[nodiscard]] static Timer after(Clock::duration delay, std::function<void()> task);
+    /// @brief Run `task` every `period`, starting one period from now, for as long as it returns `true`.
+    [[nodiscard]] static Timer every(Clock::duration period, std::function<bool()> task);
+};
+
+/// @brief Handle to a timer registered with `Scheduler`, which cancels it on destruction or reassignment.
+/// @note
+/// Cancelling a timer whose task is running waits for the task to finish, so a task can safely use whatever owns its handle. Not thread-safe itself: keep a
+/// handle to the thread that made it.
+class Timer
+{
+    std::uint64_t id = 0;
+public:
+    Timer() = default;
+    explicit Timer(std::uint64_t id) : id(id) { }
+
+    Timer(const Timer&) = delete;
+    Timer(Timer&& other) noexcept : id(std::exchange(other.id, 0)) { }
+    ~Timer() { this->cancel(); }
+
+    Timer& operator=(const Timer&) = delete;
+    Timer& operator=(Timer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            this->cancel();
+            this->id = std::exchange(other.id, 0);
+        }
+        return *this;
+    }
+
+    /// @brief Whether the timer is still due to run, or running.
+    [[nodiscard]] bool pending() const { return this->id != 0 && Scheduler::instance().pending(this->id); }
+    void cancel()
+    {
+        if (this->id != 0 && !Scheduler::tornDown.load())
+            Scheduler::instance().cancel(std::exchange(this->id, 0));
+    }
+    /// @brief Let the timer run on its own, with nothing left to cancel it.
+    void detach() { this->id = 0; }
+};
+
+inline Timer Scheduler::after(Clock::duration delay, std::function<void()> task)
+{
+    return Timer(Scheduler::instance().schedule(delay, Clock::duration::zero(), [task = std::move(task)]
+    {
+        task();
+        return false;
+    }));
+}
+inline Timer Scheduler::every(Clock::duration period, std::function<bool()> task)
+{
+    return Timer(Scheduler::instance().schedule(period, period, std::move(task)));
+}
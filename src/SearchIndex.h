@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <module/sys>
+
+#include <Catalog.h>
+
+/// @brief Track name search index, answering exact, then prefix, then substring queries over `LibraryTrack::key`.
+/// @note
+/// Keys are kept sorted, so exact and prefix matches are a single binary search, and every key is broken into byte trigrams with a posting list of the
+/// (sorted) ranks containing each, so substring matches only verify the candidates common to every trigram of the query. Within a tier, the lexicographically
+/// smallest key wins. Queries shorter than a trigram fall back to a linear scan for substring matches.
+class TrackSearchIndex
+{
+    static constexpr sz GramLength = 3_uz;
+
+    std::string keys;                   // Every key, in rank order.
+    std::vector<std::uint32_t> keyEnds; // End of each key in `keys`, by rank.
+    std::vector<std::uint32_t> tracks;  // Library index, by rank.
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> postings;
+
+    [[nodiscard]] static std::uint32_t gramAt(std::string_view str, sz at)
+    {
+        return (_as(std::uint32_t, _as(unsigned char, str[*at])) << 16u) | (_as(std::uint32_t, _as(unsigned char, str[*at + 1uz])) << 8u) | // NOLINT(readability-magic-numbers)
+            _as(std::uint32_t, _as(unsigned char, str[*at + 2uz]));
+    }
+    [[nodiscard]] std::string_view key(sz rank) const
+    {
+        const std::uint32_t beg = rank == 0_uz ? 0u : this->keyEnds[*rank - 1uz];
+        return std::string_view(this->keys).substr(beg, this->keyEnds[*rank] - beg);
+    }
+    [[nodiscard]] sz size() const { return this->tracks.size(); }
+public:
+    /// @brief Rebuild the index over `library`.
+    void rebuild(const std::vector<LibraryTrack>& library)
+    {
+        std::vector<std::uint32_t> order(library.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::ranges::sort(order, {}, [&](std::uint32_t i) -> std::string_view { return library[i].key; });
+
+        this->keys.clear();
+        this->keyEnds.clear();
+        this->postings.clear();
+        this->keyEnds.reserve(order.size());
+        this->tracks = std::move(order);
+
+        for (sz rank = 0_uz; rank < this->tracks.size(); rank++)
+        {
+            const std::string_view key = library[this->tracks[*rank]].key;
+            this->keys.append(key);
+            this->keyEnds.emplace_back(_as(std::uint32_t, this->keys.size()));
+
+            for (sz i = 0_uz; i + GramLength <= key.size(); i++)
+            {
+                std::vector<std::uint32_t>& posting = this->postings[TrackSearchIndex::gramAt(key, i)];
+                if (posting.empty() || posting.back() != *rank) // Ranks are added in order, so this dedupes repeated trigrams.
+                    posting.emplace_back(_as(std::uint32_t, *rank));
+            }
+        }
+    }
+
+    /// @brief Find the best match for `query`, which must already be normalized with `lookupKeyFrom`.
+    /// @return Index into the library the index was built from.
+    [[nodiscard]] sys::result<sz> find(std::string_view query) const
+    {
+        const auto ranks = std::views::iota(0uz, *this->size());
+        const auto first = std::ranges::lower_bound(ranks, query, {}, [this](size_t rank) { return this->key(rank); });
+        if (first != ranks.end() && this->key(*first).starts_with(query)) // Covers exact matches, which sort first among keys starting with `query`.
+            return sz(this->tracks[*first]);
+
+        if (query.size() < GramLength)
+        {
+            for (sz rank = 0_uz; rank < this->size(); rank++)
+                if (this->key(rank).contains(query))
+                    return sz(this->tracks[*rank]);
+            return nullptr;
+        }
+
+        std::vector<const std::vector<std::uint32_t>*> lists;
+        for (sz i = 0_uz; i + GramLength <= query.size(); i++)
+        {
+            const auto it = this->postings.find(TrackSearchIndex::gramAt(query, i));
+            _retif(nullptr, it == this->postings.end());
+            lists.emplace_back(&it->second);
+        }
+        std::ranges::sort(lists, {}, [](const std::vector<std::uint32_t>* list) { return list->size(); });
+
+        for (const std::uint32_t rank : *lists.front())
+        {
+            if (!std::ranges::all_of(std::span(lists).subspan(1), [&](const std::vector<std::uint32_t>* list) { return std::ranges::binary_search(*list, rank); }))
+                continue;
+            if (this->key(rank).contains(query))
+                return sz(this->tracks[rank]);
+        }
+
+        return nullptr;
+    }
+};
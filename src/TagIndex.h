@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <Catalog.h>
+#include <Metadata.h>
+
+/// @brief Which tag of a track a `Tag` refers to.
+enum class TagKind : std::uint8_t
+{
+    Genre,
+    Artist,
+    Album,
+};
+
+/// @brief One facet value, e.g. the artist `Nujabes`.
+struct Tag
+{
+    TagKind kind;
+    std::string value;
+
+    friend auto operator<=>(const Tag&, const Tag&) = default;
+
+    [[nodiscard]] static std::string_view kindName(TagKind kind)
+    {
+        switch (kind)
+        {
+        case TagKind::Genre:
+            return "genre";
+        case TagKind::Artist:
+            return "artist";
+        case TagKind::Album:
+            return "album";
+        }
+        return "";
+    }
+};
+
+/// @brief Inverted index from tags to the library tracks carrying them, immutable once built.
+/// @note
+/// Each posting list holds indices into the tracks it was built over, which it keeps, in ascending order. Filtering unions the lists of the selected tags of one kind and intersects the results
+/// across kinds, smallest first, galloping through the larger lists, so its cost tracks the size of the answer rather than of the library.
+class TagIndex
+{
+    using Posting = std::vector<std::uint32_t>;
+
+    std::shared_ptr<const std::vector<LibraryTrack>> tracks = std::make_shared<const std::vector<LibraryTrack>>();
+    std::map<Tag, Posting> postings; // Ordered by kind, then value.
+
+    [[nodiscard]] static const std::string& valueOf(TagKind kind, const TrackMetadata& meta)
+    {
+        switch (kind)
+        {
+        case TagKind::Genre:
+            return meta.genre;
+        case TagKind::Artist:
+            return meta.artist;
+        case TagKind::Album:
+            return meta.album;
+        }
+        return meta.genre;
+    }
+
+    /// @brief Union of sorted `lists`.
+    [[nodiscard]] static Posting unite(std::span<const Posting* const> lists)
+    {
+        if (lists.size() == 1)
+            return *lists.front();
+
+        Posting ret;
+        for (const Posting* list : lists)
+        {
+            Posting merged;
+            merged.reserve(ret.size() + list->size());
+            std::ranges::set_union(ret, *list, std::back_inserter(merged));
+            ret = std::move(merged);
+        }
+        return ret;
+    }
+    /// @brief Keep the elements of sorted `into` also in sorted `list`.
+    static void intersect(Posting& into, const Posting& list)
+    {
+        auto from = list.begin();
+        std::erase_if(into, [&](std::uint32_t id)
+        {
+            // Galloping search from the last match, since `into` is usually much shorter than `list`.
+            std::ptrdiff_t step = 1;
+            auto hi = from;
+            while (hi != list.end() && *hi < id)
+            {
+                from = hi;
+                hi = std::distance(hi, list.end()) > step ? std::next(hi, step) : list.end();
+                step *= 2;
+            }
+            from = std::lower_bound(from, hi, id);
+            return from == list.end() || *from != id;
+        });
+    }
+public:
+    TagIndex() = default;
+    /// @brief Index `library`, using whatever metadata `MetadataStore` currently has.
+    explicit TagIndex(std::shared_ptr<const std::vector<LibraryTrack>> library) : tracks(std::move(library))
+    {
+        for (sz i = 0_uz; i < this->tracks->size(); i++)
+        {
+            const std::shared_ptr<const TrackMetadata> meta = MetadataStore::find((*this->tracks)[*i]);
+            if (!meta)
+                continue;
+
+            for (const TagKind kind : { TagKind::Genre, TagKind::Artist, TagKind::Album })
+                if (const std::string& value = TagIndex::valueOf(kind, *meta); !value.empty())
+                    this->postings[Tag { .kind = kind, .value = value }].emplace_back(_as(std::uint32_t, *i));
+        }
+    }
+
+    /// @brief The tracks indexed, as they were when the index was built.
+    [[nodiscard]] const std::vector<LibraryTrack>& library() const { return *this->tracks; }
+    /// @brief Every tag with the indices into `library()` of the tracks carrying it, ordered by kind, then value.
+    [[nodiscard]] const std::map<Tag, Posting>& tags() const { return this->postings; }
+
+    /// @brief Indices into `library()`, ascending, of the tracks matching any selected tag of every kind in `selected`.
+    [[nodiscard]] std::vector<std::uint32_t> filter(const std::set<Tag>& selected) const
+    {
+        std::vector<Posting> perKind;
+        for (auto it = selected.begin(); it != selected.end();)
+        {
+            std::vector<const Posting*> lists;
+            const TagKind kind = it->kind;
+            for (; it != selected.end() && it->kind == kind; ++it)
+                if (const auto found = this->postings.find(*it); found != this->postings.end())
+                    lists.emplace_back(&found->second);
+            _retif({}, lists.empty());
+
+            perKind.emplace_back(TagIndex::unite(lists));
+        }
+        _retif({}, perKind.empty());
+
+        std::ranges::sort(perKind, {}, [](const Posting& list) { return list.size(); });
+        Posting ret = std::move(perKind.front());
+        for (const Posting& list : std::span(perKind).subspan(1))
+        {
+            _retif(ret, ret.empty());
+            TagIndex::intersect(ret, list);
+        }
+        return ret;
+    }
+    /// @brief Whether a track tagged `meta` matches `selected`, as `filter` would have it.
+    [[nodiscard]] static bool matches(const std::set<Tag>& selected, const TrackMetadata& meta)
+    {
+        for (auto it = selected.begin(); it != selected.end();)
+        {
+            bool any = false;
+            const TagKind kind = it->kind;
+            for (; it != selected.end() && it->kind == kind; ++it)
+                any |= it->value == TagIndex::valueOf(kind, meta);
+            _retif(false, !any);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#ifndef TACRAD_TRACING
+#define TACRAD_TRACING 1 // NOLINT(cppcoreguidelines-macro-usage)
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <Config.h>
+
+/// @brief Scoped timing of hot paths, dumped as Chrome trace JSON for `chrome://tracing` or Perfetto.
+/// @note
+/// Each thread records completed spans into its own fixed ring, overwriting the oldest, so recording takes no lock and only allocates on a thread's first
+/// span. Spans are recorded with `_trace_scope`, which compiles away entirely when built without `TACRAD_TRACING`.
+class Trace
+{
+    struct Event
+    {
+        // Nanoseconds since `Trace::epoch`. Atomic only so a dump can read them while they're being overwritten.
+        std::atomic<const char*> name = nullptr;
+        std::atomic<std::int64_t> begin = 0;
+        std::atomic<std::int64_t> end = 0;
+    };
+    struct ThreadBuffer
+    {
+        std::array<Event, Config::TraceEventsPerThread> events {};
+        std::atomic<size_t> written = 0;
+        std::uint32_t tid = 0;
+        std::string name; // Guarded by `Trace::registryLock`.
+        std::atomic<bool> retired = false;
+    };
+    struct ThreadHandle
+    {
+        std::shared_ptr<ThreadBuffer> buffer;
+
+        ThreadHandle() = default;
+        ThreadHandle(const ThreadHandle&) = delete;
+        ThreadHandle(ThreadHandle&&) = delete;
+        ~ThreadHandle()
+        {
+            if (this->buffer)
+                this->buffer->retired = true;
+        }
+
+        ThreadHandle& operator=(const ThreadHandle&) = delete;
+        ThreadHandle& operator=(ThreadHandle&&) = delete;
+    };
+
+    static inline const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    static inline std::mutex registryLock;
+    static inline std::vector<std::shared_ptr<ThreadBuffer>> registry;
+    static inline std::uint32_t nextTid = 1;
+
+    static ThreadBuffer& current()
+    {
+        thread_local ThreadHandle handle;
+        if (!handle.buffer) [[unlikely]]
+        {
+            handle.buffer = std::make_shared<ThreadBuffer>();
+
+            const std::scoped_lock guard(Trace::registryLock);
+            handle.buffer->tid = Trace::nextTid++;
+            handle.buffer->name = std::format("thread {}", handle.buffer->tid);
+
+            // Keep the spans of threads that have exited, but only so many of them, since pools come and go.
+            const auto retired = [](const std::shared_ptr<ThreadBuffer>& buffer) { return buffer->retired.load(); };
+            while (_as(size_t, std::ranges::count_if(Trace::registry, retired)) > Config::TraceRetiredThreads)
+                Trace::registry.erase(std::ranges::find_if(Trace::registry, retired));
+            Trace::registry.emplace_back(handle.buffer);
+        }
+        return *handle.buffer;
+    }
+    static void appendEscaped(std::string& out, std::string_view str)
+    {
+        for (const char c : str)
+        {
+            if (c == '"' || c == '\\')
+                out.push_back('\\');
+            out.push_back(_as(unsigned char, c) < 0x20u ? ' ' : c); // NOLINT(readability-magic-numbers)
+        }
+    }
+public:
+    static constexpr bool Enabled = TACRAD_TRACING != 0;
+
+    Trace() = delete;
+
+    [[nodiscard]] static std::int64_t now() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Trace::epoch).count(); }
+
+    /// @brief Record a span on the calling thread. `name` must have static storage duration.
+    static void record(const char* name, std::int64_t begin, std::int64_t end)
+    {
+        ThreadBuffer& buffer = Trace::current();
+        const size_t at = buffer.written.load(std::memory_order_relaxed);
+        Event& event = buffer.events[at % buffer.events.size()];
+        event.name.store(name, std::memory_order_relaxed);
+        event.begin.store(begin, std::memory_order_relaxed);
+        event.end.store(end, std::memory_order_relaxed);
+        buffer.written.store(at + 1, std::memory_order_release);
+    }
+    /// @brief Name the calling thread in dumps.
+    static void nameThread(std::string_view name)
+    {
+        ThreadBuffer& buffer = Trace::current();
+        const std::scoped_lock guard(Trace::registryLock);
+        buffer.name = name;
+    }
+
+    /// @brief Write every span still held to `file`, as Chrome trace JSON.
+    /// @return How many spans were written, or nothing if the file couldn't be.
+    static sys::result<sz> dump(const std::filesystem::path& file)
+    {
+        std::string json = R"({"displayTimeUnit":"ms","traceEvents":[)";
+        sz count = 0_uz;
+        {
+            const std::scoped_lock guard(Trace::registryLock);
+            for (const std::shared_ptr<ThreadBuffer>& buffer : Trace::registry)
+            {
+                json.append(std::format(R"({}{{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":")", json.back() == '[' ? "" : ",",
+                                        buffer->tid));
+                Trace::appendEscaped(json, buffer->name);
+                json.append(R"("}})");
+
+                const size_t capacity = buffer->events.size();
+                const size_t written = buffer->written.load(std::memory_order_acquire);
+                std::vector<std::pair<size_t, std::array<std::int64_t, 2>>> spans;
+                std::vector<const char*> names;
+                for (size_t i = written > capacity ? written - capacity : 0; i < written; i++)
+                {
+                    const Event& event = buffer->events[i % capacity];
+                    names.emplace_back(event.name.load(std::memory_order_relaxed));
+                    spans.emplace_back(i, std::array { event.begin.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed) });
+                }
+
+                // Drop whatever the thread may have overwritten while it was being copied.
+                const size_t after = buffer->written.load(std::memory_order_acquire);
+                for (size_t j = 0; j < spans.size(); j++)
+                {
+                    const auto& [i, span] = spans[j];
+                    if (after >= capacity && i <= after - capacity)
+                        continue;
+
+                    json.append(R"(,{"name":")");
+                    Trace::appendEscaped(json, names[j] != nullptr ? names[j] : "?");
+                    json.append(std::format(R"(","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}})", buffer->tid, _as(double, span[0]) / 1e3, // NOLINT(readability-magic-numbers)
+                                            _as(double, span[1] - span[0]) / 1e3));                                                           // NOLINT(readability-magic-numbers)
+                    ++count;
+                }
+            }
+        }
+        json.append("]}\n");
+
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out.write(json.data(), _as(std::streamsize, json.size()));
+        _retif(nullptr, !out);
+        return count;
+    }
+};
+
+/// @brief Records the span of its own lifetime as a trace event.
+class TraceScope
+{
+    const char* name;
+    std::int64_t begin;
+public:
+    explicit TraceScope(const char* name) : name(name), begin(Trace::now()) { }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope(TraceScope&&) = delete;
+    ~TraceScope() { Trace::record(this->name, this->begin, Trace::now()); }
+
+    TraceScope& operator=(const TraceScope&) = delete;
+    TraceScope& operator=(TraceScope&&) = delete;
+};
+
+#if TACRAD_TRACING
+    #define _impl_trace_concat_inner(a, b) a##b
+    #define _impl_trace_concat(a, b)       _impl_trace_concat_inner(a, b)
+    /// @brief Trace the rest of the enclosing scope as a span named `name`, a string literal.
+    #define _trace_scope(name) const TraceScope _impl_trace_concat(_traceScope, __LINE__)(name)
+    /// @brief Name the calling thread in trace dumps.
+    #define _trace_thread(name) Trace::nameThread(name)
+#else
+    #define _trace_scope(name)  static_cast<void>(0)
+    #define _trace_thread(name) static_cast<void>(0)
+#endif
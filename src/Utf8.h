@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <module/sys>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define _utf8_sse2 1
+#endif
+
+/// @brief UTF-8 validation and transcoding.
+/// @note
+/// Runs of ASCII are transcoded a vector at a time (AVX2, SSE4.1 or SSE2, whichever the target enables), falling back to a scalar decoder, which fully
+/// validates (rejecting overlong encodings, surrogates and code points past U+10FFFF), for anything else.
+struct Utf8
+{
+    Utf8() = delete;
+
+    /// @brief Decode one code point starting at `in[at]`, advancing `at` past it.
+    /// @return The code point, or `~0` if the sequence is malformed.
+    [[nodiscard]] static char32_t decodeOne(std::string_view in, size_t& at)
+    {
+        constexpr char32_t Invalid = ~char32_t(0);
+        // NOLINTBEGIN(readability-magic-numbers)
+        const auto lead = _as(std::uint8_t, in[at]);
+        size_t len = 0;
+        char32_t cp = 0;
+        char32_t min = 0;
+        if (lead < 0x80u)
+        {
+            ++at;
+            return lead;
+        }
+        if ((lead & 0xE0u) == 0xC0u)
+        {
+            len = 2;
+            cp = lead & 0x1Fu;
+            min = 0x80;
+        }
+        else if ((lead & 0xF0u) == 0xE0u)
+        {
+            len = 3;
+            cp = lead & 0x0Fu;
+            min = 0x800;
+        }
+        else if ((lead & 0xF8u) == 0xF0u)
+        {
+            len = 4;
+            cp = lead & 0x07u;
+            min = 0x10000;
+        }
+        else
+            return Invalid;
+
+        if (in.size() - at < len)
+            return Invalid;
+        for (size_t i = 1; i < len; i++)
+        {
+            const auto cont = _as(std::uint8_t, in[at + i]);
+            if ((cont & 0xC0u) != 0x80u)
+                return Invalid;
+            cp = (cp << 6u) | (cont & 0x3Fu);
+        }
+        if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            return Invalid;
+        // NOLINTEND(readability-magic-numbers)
+
+        at += len;
+        return cp;
+    }
+
+    /// @brief Transcode the longest prefix of `in` from `at` that is pure ASCII, a vector at a time, stopping short of the first non-ASCII vector.
+    static void widenAscii(std::string_view in, size_t& at, char32_t* out, size_t& outAt)
+    {
+        // NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        const char* src = in.data();
+#if defined(__AVX2__)
+        constexpr size_t Width = 32;
+        for (; in.size() - at >= Width; at += Width, outAt += Width)
+        {
+            const __m256i v = _mm256_loadu_si256(_as(const __m256i*, _as(const void*, src + at)));
+            if (_mm256_movemask_epi8(v) != 0)
+                return;
+
+            for (size_t i = 0; i < Width; i += 8) // NOLINT(readability-magic-numbers)
+                _mm256_storeu_si256(_as(__m256i*, _as(void*, out + outAt + i)), _mm256_cvtepu8_epi32(_mm_loadl_epi64(_as(const __m128i*, _as(const void*, src + at + i)))));
+        }
+#elif defined(__SSE4_1__)
+        constexpr size_t Width = 16;
+        for (; in.size() - at >= Width; at += Width, outAt += Width)
+        {
+            __m128i v = _mm_loadu_si128(_as(const __m128i*, _as(const void*, src + at)));
+            if (_mm_movemask_epi8(v) != 0)
+                return;
+
+            for (size_t i = 0; i < Width; i += 4, v = _mm_srli_si128(v, 4))
+                _mm_storeu_si128(_as(__m128i*, _as(void*, out + outAt + i)), _mm_cvtepu8_epi32(v));
+        }
+#elif defined(_utf8_sse2)
+        constexpr size_t Width = 16;
+        const __m128i zero = _mm_setzero_si128();
+        for (; in.size() - at >= Width; at += Width, outAt += Width)
+        {
+            const __m128i v = _mm_loadu_si128(_as(const __m128i*, _as(const void*, src + at)));
+            if (_mm_movemask_epi8(v) != 0)
+                return;
+
+            const __m128i lo = _mm_unpacklo_epi8(v, zero);
+            const __m128i hi = _mm_unpackhi_epi8(v, zero);
+            _mm_storeu_si128(_as(__m128i*, _as(void*, out + outAt)), _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128(_as(__m128i*, _as(void*, out + outAt + 4)), _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128(_as(__m128i*, _as(void*, out + outAt + 8)), _mm_unpacklo_epi16(hi, zero)); // NOLINT(readability-magic-numbers)
+            _mm_storeu_si128(_as(__m128i*, _as(void*, out + outAt + 12)), _mm_unpackhi_epi16(hi, zero)); // NOLINT(readability-magic-numbers)
+        }
+#else
+        constexpr size_t Width = 8;
+        for (; in.size() - at >= Width; at += Width, outAt += Width)
+        {
+            std::uint64_t word = 0;
+            for (size_t i = 0; i < Width; i++)
+                word |= _as(std::uint64_t, _as(std::uint8_t, src[at + i])) << (i * 8); // NOLINT(readability-magic-numbers)
+            if (word & 0x8080808080808080ull) // NOLINT(readability-magic-numbers)
+                return;
+
+            for (size_t i = 0; i < Width; i++)
+                out[outAt + i] = _as(char32_t, _as(std::uint8_t, src[at + i]));
+        }
+#endif
+        // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    }
+
+    /// @brief Validate `in` and transcode it to UTF-32 into `out`.
+    /// @return Whether `in` was valid UTF-8. `out` is unspecified if not.
+    [[nodiscard]] static bool decode(std::string_view in, std::u32string& out)
+    {
+        // Never more code points than bytes, so size for the worst case once and trim afterwards.
+        bool valid = true;
+        out.resize_and_overwrite(in.size(), [&](char32_t* buf, size_t) -> size_t
+        {
+            size_t at = 0, outAt = 0;
+            while (at < in.size())
+            {
+                Utf8::widenAscii(in, at, buf, outAt);
+                for (bool sawMultibyte = false; at < in.size();)
+                {
+                    const bool ascii = _as(std::uint8_t, in[at]) < 0x80u; // NOLINT(readability-magic-numbers)
+                    sawMultibyte |= !ascii;
+                    const char32_t cp = Utf8::decodeOne(in, at);
+                    if (cp == ~char32_t(0))
+                    {
+                        valid = false;
+                        return 0;
+                    }
+                    buf[outAt++] = cp; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+                    if (ascii && sawMultibyte) // Back to a run of ASCII past what stopped the vector loop, so try vectors again.
+                        break;
+                }
+            }
+            return outAt;
+        });
+        return valid;
+    }
+
+    /// @brief Transcode UTF-32 `in` to UTF-8, replacing invalid code points with U+FFFD.
+    [[nodiscard]] static std::string encode(std::u32string_view in)
+    {
+        std::string ret;
+        ret.reserve(in.size());
+        // NOLINTBEGIN(readability-magic-numbers)
+        for (char32_t cp : in)
+        {
+            if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+                cp = 0xFFFD;
+
+            if (cp < 0x80)
+                ret.push_back(_as(char, cp));
+            else if (cp < 0x800)
+            {
+                ret.push_back(_as(char, 0xC0u | (cp >> 6u)));
+                ret.push_back(_as(char, 0x80u | (cp & 0x3Fu)));
+            }
+            else if (cp < 0x10000)
+            {
+                ret.push_back(_as(char, 0xE0u | (cp >> 12u)));
+                ret.push_back(_as(char, 0x80u | ((cp >> 6u) & 0x3Fu)));
+                ret.push_back(_as(char, 0x80u | (cp & 0x3Fu)));
+            }
+            else
+            {
+                ret.push_back(_as(char, 0xF0u | (cp >> 18u)));
+                ret.push_back(_as(char, 0x80u | ((cp >> 12u) & 0x3Fu)));
+                ret.push_back(_as(char, 0x80u | ((cp >> 6u) & 0x3Fu)));
+                ret.push_back(_as(char, 0x80u | (cp & 0x3Fu)));
+            }
+        }
+        // NOLINTEND(readability-magic-numbers)
+        return ret;
+    }
+};
+
+#undef _utf8_sse2
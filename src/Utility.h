@@ -1,57 +1,89 @@
 #pragma once
 
+#include <algorithm>
 #include <cctype>
-#include <codecvt>
+#include <charconv>
 #include <filesystem>
-#include <locale>
-#include <memory>
-#include <set>
-#include <stdexcept>
+#include <span>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <utility>
 #include <vector>
 
 #include <module/sys>
 
+#include <CaseFold.h>
+#include <Config.h>
 #include <Debug.h>
+#include <Utf8.h>
 
 /// @brief Convert a `std::string` to `std::u32string`.
 [[nodiscard]] inline std::u32string u32stringFrom(std::string_view str)
 {
-    try
-    {
-        _push_nowarn_deprecated();
-        return std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t>().from_bytes(std::to_address(str.begin()), std::to_address(str.end()));
-        _pop_nowarn_deprecated();
-    }
-    catch (const std::range_error&)
+    std::u32string ret;
+    if (!Utf8::decode(str, ret))
     {
         debugLog("Range error: {}.", str);
         return U"";
     }
+    return ret;
 }
 /// @brief Convert a `std::u8string` to `std::string`.
 [[nodiscard]] inline std::string stringFrom(std::u8string_view str) { return { str.begin(), str.end() }; }
+/// @brief Convert a `std::u32string` to `std::string`.
+[[nodiscard]] inline std::string stringFrom(std::u32string_view str) { return Utf8::encode(str); }
 
-inline std::u32string u32stringToLower(std::u32string_view str)
+inline std::u32string u32stringToLower(std::u32string_view str) { return CaseFold::foldString(str, false); }
+
+/// @brief Normalize a track name into the key lookups compare against.
+/// @note Computed once per track when the library is scanned, and once per query.
+[[nodiscard]] inline std::string lookupKeyFrom(std::string_view name)
 {
-    std::u32string ret;
-    ret.reserve(str.size());
-    for (const char32_t c : str)
-        ret.push_back(_as(char32_t, std::tolower(_as(int, c))));
-    return ret;
+    if (std::ranges::all_of(name, [](char c) { return _as(unsigned char, c) < 0x80u; })) // NOLINT(readability-magic-numbers)
+    {
+        std::string ret(name);
+        for (char& c : ret)
+            c = _as(char, CaseFold::fold(_as(unsigned char, c)));
+        return ret;
+    }
+    return stringFrom(CaseFold::foldString(u32stringFrom(name), Config::LookupIgnoresDiacritics));
 }
-
-inline void wstringSplitLengthConstrained(std::string_view str, sz len, std::vector<std::string>& out)
+/// @brief `lookupKeyFrom` of `words` joined by single spaces, without joining them first when they're ASCII.
+[[nodiscard]] inline std::string lookupKeyFrom(std::span<const std::string_view> words)
 {
-    for (sz i = 0_uz; i < str.size();)
+    const auto isAscii = [](std::string_view word) { return std::ranges::all_of(word, [](char c) { return _as(unsigned char, c) < 0x80u; }); }; // NOLINT(readability-magic-numbers)
+    if (!std::ranges::all_of(words, isAscii))
     {
-        sz iEnd = i;
-        while (iEnd < str.size() && str[iEnd] != '\n' && sz(iEnd - i) < sz(len))
-            iEnd++;
-        out.emplace_back(str.substr(sz(i), sz(iEnd - i)));
-        i = (iEnd == i || (iEnd < str.size() && str[iEnd] == '\n')) ? iEnd + 1_uz : iEnd;
+        std::string joined;
+        for (const std::string_view word : words)
+            joined.append(word).push_back(' ');
+        if (!joined.empty())
+            joined.pop_back();
+        return lookupKeyFrom(joined);
     }
+
+    std::string ret;
+    for (sz i = 0_uz; i < words.size(); i++)
+    {
+        if (i != 0_uz)
+            ret.push_back(' ');
+        for (const char c : words[*i])
+            ret.push_back(_as(char, CaseFold::fold(_as(unsigned char, c))));
+    }
+    return ret;
+}
+
+/// @brief Parse the whole of `str` as a number, allowing a leading `+` as `strtof` did.
+[[nodiscard]] inline sys::result<float> floatFrom(std::string_view str)
+{
+    if (str.starts_with('+') && !str.substr(1).starts_with('-'))
+        str.remove_prefix(1);
+
+    float ret = 0.0f;
+    const std::from_chars_result read = std::from_chars(str.data(), str.data() + str.size(), ret); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    _retif(nullptr, read.ec != std::errc {} || read.ptr != str.data() + str.size());            // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    return ret;
 }
 
 [[nodiscard]] inline std::string wstringLastLineTrimmed(std::string_view str)
@@ -72,18 +104,6 @@ inline void wstringSplitLengthConstrained(std::string_view str, sz len, std::vec
     return std::string(str.substr(beg, end - beg));
 }
 
-[[nodiscard]] inline bool setVecStartsWith(const std::vector<std::set<std::string_view>>& setVec, const std::vector<std::string>& with)
-{
-    sz i = 0_uz;
-    for (const auto& tokenSet : setVec)
-    {
-        if (i >= with.size() || !tokenSet.contains(with[i]))
-            return false;
-        ++i;
-    }
-    return true;
-}
-
 /// @brief Base64 encode a string for OSC 52 clipboard.
 [[nodiscard]] inline std::string base64Encode(std::string_view input)
 {
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <Preamble.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stop_token>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <Catalog.h>
+#include <Config.h>
+#include <Debug.h>
+#include <Exec.inl>
+#include <RenderScheduler.h>
+#include <Scanner.h>
+#include <Screen.h>
+#include <Utility.h>
+
+#if __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/// @brief A coalesced batch of changes to the music library.
+/// @note Apply `rescanned` first, if set, then `removed` and `removedDirs`, then `added`.
+struct LibraryChanges
+{
+    std::optional<LibrarySnapshot> rescanned; // Events were lost, so the library was scanned again, and this replaces it wholesale.
+    std::map<std::filesystem::path, LibraryTrack> added; // Includes files rewritten in place.
+    std::set<std::filesystem::path> removed;
+    std::set<std::filesystem::path> removedDirs;
+    std::map<std::filesystem::path, i64> dirs; // New or modified directories, with their new modification times.
+
+    [[nodiscard]] bool empty() const { return !this->rescanned && this->added.empty() && this->removed.empty() && this->removedDirs.empty() && this->dirs.empty(); }
+
+    /// @brief Whether `file` is beneath `dir`.
+    [[nodiscard]] static bool beneath(const std::filesystem::path& file, const std::filesystem::path& dir)
+    {
+        return file.native().starts_with((dir / "").native());
+    }
+};
+
+/// @brief Watches the music library for changes and reports them in coalesced batches on the UI thread.
+/// @note
+/// Linux only, using inotify. Elsewhere, `watch` does nothing and the library only changes on `rescan`.
+/// Bursts of events are batched until the library has been quiet for `Config::LibraryWatchCoalesceDelay`, then posted with a single `Screen().Post`. Should
+/// events be lost, the library is rescanned (and the catalog saved) on the watcher thread too, and only the result posted.
+class LibraryWatcher
+{
+public:
+    using Callback = std::function<void(LibraryChanges)>;
+private:
+    Callback onChanges;
+
+    std::mutex pendingLock;
+    LibraryChanges pending;
+    std::shared_ptr<const LibrarySnapshot> pendingSave;
+
+#if __linux__
+    int inotifyFd = -1;
+    int wakeFd = -1;
+    std::map<int, std::filesystem::path> watches;
+    bool overflowed = false; // Since the last `rescan`.
+
+    void addWatch(const std::filesystem::path& dir)
+    {
+        const int wd = inotify_add_watch(this->inotifyFd, dir.c_str(), IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR);
+        if (wd >= 0)
+        {
+            this->watches[wd] = dir;
+            return;
+        }
+
+        static bool warned = false;
+        if (!std::exchange(warned, true))
+            debugLog("[log.warn] Failed to watch `{}` for changes, with errno {}.", pathToString(dir), errno);
+    }
+    void removeWatchesBeneath(const std::filesystem::path& dir)
+    {
+        std::erase_if(this->watches, [&](const auto& watch)
+        {
+            if (watch.second != dir && !LibraryChanges::beneath(watch.second, dir))
+                return false;
+
+            inotify_rm_watch(this->inotifyFd, watch.first);
+            return true;
+        });
+    }
+
+    /// @note Called with `pendingLock` held.
+    void fileAdded(const std::filesystem::path& file)
+    {
+        std::error_code ec;
+        const std::filesystem::directory_entry entry(file, ec);
+        _retif(, ec || !entry.is_regular_file(ec));
+
+        const std::uintmax_t size = entry.file_size(ec);
+        std::string name = stringFrom(file.stem().generic_u8string());
+        std::string key = lookupKeyFrom(name);
+        this->pending.added.insert_or_assign(file, LibraryTrack { .name = std::move(name),
+                                                                  .file = file,
+                                                                  .key = std::move(key),
+                                                                  .mtime = LibraryCatalog::mtimeOf(file),
+                                                                  .size = u64(ec ? std::uint64_t(0) : _as(std::uint64_t, size)) });
+    }
+    /// @note Called with `pendingLock` held.
+    void fileRemoved(const std::filesystem::path& file)
+    {
+        this->pending.added.erase(file);
+        this->pending.removed.insert(file);
+    }
+    /// @note Called with `pendingLock` held.
+    void dirAdded(const std::filesystem::path& dir)
+    {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+
+        this->addWatch(dir);
+        this->pending.dirs.insert_or_assign(dir, LibraryCatalog::mtimeOf(dir));
+        for (fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::error_code entryEc;
+            if (it->is_directory(entryEc))
+            {
+                this->addWatch(it->path());
+                this->pending.dirs.insert_or_assign(it->path(), LibraryCatalog::mtimeOf(it->path()));
+            }
+            else
+                this->fileAdded(it->path());
+        }
+    }
+    /// @note Called with `pendingLock` held.
+    void dirRemoved(const std::filesystem::path& dir)
+    {
+        this->removeWatchesBeneath(dir);
+        std::erase_if(this->pending.added, [&](const auto& added) { return LibraryChanges::beneath(added.first, dir); });
+        std::erase_if(this->pending.dirs, [&](const auto& changed) { return changed.first == dir || LibraryChanges::beneath(changed.first, dir); });
+        this->pending.removedDirs.insert(dir);
+    }
+
+    /// @return Whether any changes were recorded.
+    bool drainEvents()
+    {
+        alignas(inotify_event) std::array<char, 64uz * 1024uz> buf {}; // NOLINT(readability-magic-numbers)
+
+        bool ret = false;
+        ssize_t len = 0;
+        while ((len = ::read(this->inotifyFd, buf.data(), buf.size())) > 0)
+        {
+            const std::unique_lock guard(this->pendingLock);
+            for (ssize_t at = 0; at < len;)
+            {
+                const auto* event = _as(const inotify_event*, _as(const void*, &buf[_as(size_t, at)]));
+                at += _as(ssize_t, sizeof(inotify_event) + event->len);
+                ret = true;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    this->overflowed = true;
+                    continue;
+                }
+                if (event->mask & IN_IGNORED)
+                {
+                    this->watches.erase(event->wd);
+                    continue;
+                }
+
+                const auto watch = this->watches.find(event->wd);
+                if (watch == this->watches.end())
+                    continue;
+                const std::filesystem::path dir = watch->second;
+
+                if (event->mask & IN_DELETE_SELF)
+                {
+                    this->dirRemoved(dir);
+                    continue;
+                }
+
+                const std::filesystem::path path = dir / std::filesystem::path(std::string(event->name)); // NOLINT(cppcoreguidelines-pro-bounds-array-to-pointer-decay)
+                if (event->mask & IN_ISDIR)
+                {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                        this->dirAdded(path);
+                    else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                        this->dirRemoved(path);
+                }
+                else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                    this->fileAdded(path);
+                else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                    this->fileRemoved(path);
+
+                this->pending.dirs.insert_or_assign(dir, LibraryCatalog::mtimeOf(dir));
+            }
+        }
+
+        return ret;
+    }
+    /// @brief Scan the library again, having lost events, and watch what's there now.
+    /// @note
+    /// Everything recorded so far is superseded by the scan. Events arriving during it are left queued, to be applied on top, so watches are only swapped once
+    /// it's done.
+    void rescan()
+    {
+        std::vector<std::string> messages { "[log.warn] Library watcher lost events, rescanning." };
+        LibrarySnapshot snapshot = LibraryScanner::scan(Config::MusicDirectory, 0_uz, &messages);
+        (void)LibraryCatalog::save(Config::LibraryCatalogFile, snapshot);
+        Screen().Post([messages = std::move(messages)]
+        {
+            for (const std::string& line : messages)
+                CommandInvocation::println("{}", line);
+        });
+
+        std::set<std::filesystem::path> dirs;
+        for (const LibraryDirectory& dir : snapshot.dirs)
+            dirs.insert(dir.dir);
+        std::erase_if(this->watches, [&](const auto& watch)
+        {
+            if (dirs.contains(watch.second))
+                return false;
+
+            inotify_rm_watch(this->inotifyFd, watch.first);
+            return true;
+        });
+        for (const std::filesystem::path& dir : dirs)
+            this->addWatch(dir);
+
+        const std::unique_lock guard(this->pendingLock);
+        this->pending = {};
+        this->pending.rescanned = std::move(snapshot);
+        this->pendingSave = nullptr; // Older than what was just saved.
+        this->overflowed = false;
+    }
+    void publish()
+    {
+        {
+            const std::unique_lock guard(this->pendingLock);
+            _retif(, this->pending.empty());
+        }
+
+        Screen().Post([this]
+        {
+            LibraryChanges changes;
+            {
+                const std::unique_lock guard(this->pendingLock);
+                changes = std::exchange(this->pending, {});
+            }
+            _retif(, changes.empty());
+
+            this->onChanges(std::move(changes));
+            RenderScheduler::request();
+        });
+    }
+    void persist()
+    {
+        std::shared_ptr<const LibrarySnapshot> snapshot;
+        {
+            const std::unique_lock guard(this->pendingLock);
+            snapshot = std::exchange(this->pendingSave, nullptr);
+        }
+        if (snapshot)
+            (void)LibraryCatalog::save(Config::LibraryCatalogFile, *snapshot);
+    }
+
+    void run(const std::stop_token& token)
+    {
+        std::array<pollfd, 2> fds { pollfd { .fd = this->inotifyFd, .events = POLLIN, .revents = 0 }, pollfd { .fd = this->wakeFd, .events = POLLIN, .revents = 0 } };
+        bool dirty = false;
+        while (!token.stop_requested())
+        {
+            const int ready = ::poll(fds.data(), fds.size(), dirty ? _as(int, Config::LibraryWatchCoalesceDelay.count()) : -1);
+            if (ready < 0 && errno != EINTR)
+                break;
+
+            if (ready == 0)
+            {
+                this->publish();
+                dirty = false;
+            }
+            if (fds[0].revents & POLLIN)
+                dirty = this->drainEvents() || dirty;
+            if (this->overflowed)
+                this->rescan();
+            if (fds[1].revents & POLLIN)
+            {
+                eventfd_t value = 0;
+                (void)eventfd_read(this->wakeFd, &value);
+            }
+
+            this->persist();
+        }
+    }
+    void wake() const
+    {
+        if (this->wakeFd >= 0)
+            (void)eventfd_write(this->wakeFd, 1);
+    }
+#endif
+
+    std::jthread thread;
+public:
+    LibraryWatcher() = default;
+    LibraryWatcher(const LibraryWatcher&) = delete;
+    LibraryWatcher(LibraryWatcher&&) = delete;
+    ~LibraryWatcher() { this->stop(); }
+
+    LibraryWatcher& operator=(const LibraryWatcher&) = delete;
+    LibraryWatcher& operator=(LibraryWatcher&&) = delete;
+
+    /// @brief Start watching `dirs`, replacing anything watched before.
+    /// @param onChanges Invoked on the UI thread with every coalesced batch of changes.
+    void watch(const std::vector<LibraryDirectory>& dirs, Callback onChanges)
+    {
+        this->stop();
+        this->onChanges = std::move(onChanges);
+
+#if __linux__
+        this->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        this->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (this->inotifyFd < 0 || this->wakeFd < 0)
+        {
+            debugLog("[log.warn] Failed to initialize inotify, with errno {}; library changes won't be picked up until `rescan`.", errno);
+            this->stop();
+            return;
+        }
+
+        for (const LibraryDirectory& dir : dirs)
+            this->addWatch(dir.dir);
+
+        this->thread = std::jthread([this](const std::stop_token& token) { this->run(token); });
+#else
+        (void)dirs;
+#endif
+    }
+    /// @brief Stop watching, discarding unpublished changes.
+    void stop()
+    {
+#if __linux__
+        if (this->thread.joinable())
+        {
+            this->thread.request_stop();
+            this->wake();
+            this->thread.join();
+        }
+        this->persist();
+
+        if (this->inotifyFd >= 0)
+            ::close(this->inotifyFd);
+        if (this->wakeFd >= 0)
+            ::close(this->wakeFd);
+        this->inotifyFd = this->wakeFd = -1;
+        this->watches.clear();
+#endif
+
+        const std::unique_lock guard(this->pendingLock);
+        this->pending = {};
+    }
+
+    /// @brief Write `snapshot` to the library catalog from the watcher thread, so the UI thread doesn't block on it.
+    /// @note Writes synchronously if the watcher isn't running.
+    void save(std::shared_ptr<const LibrarySnapshot> snapshot)
+    {
+#if __linux__
+        if (this->thread.joinable())
+        {
+            {
+                const std::unique_lock guard(this->pendingLock);
+                this->pendingSave = std::move(snapshot);
+            }
+            this->wake();
+            return;
+        }
+#endif
+
+        (void)LibraryCatalog::save(Config::LibraryCatalogFile, *snapshot);
+    }
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+/// @brief Fixed-size work-stealing thread pool.
+/// @note
+/// Every worker owns a deque; tasks submitted from a worker go to the back of its own deque and are popped LIFO, while idle workers steal FIFO from the front of
+/// others'. Tasks receive the index of the worker running them, so callers can keep per-worker state without locking.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(WorkStealingPool&, sz worker)>;
+private:
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    static inline thread_local WorkStealingPool* currentPool = nullptr;
+    static inline thread_local sz currentWorker = 0_uz;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> queued = 0;  // Tasks sitting in some deque, only modified under that deque's lock.
+    std::atomic<size_t> pending = 0; // Tasks submitted but not yet finished.
+    std::atomic<size_t> nextSubmit = 0;
+
+    std::mutex idleLock;
+    std::condition_variable_any idleCv;
+    std::mutex doneLock;
+    std::condition_variable doneCv;
+
+    std::vector<std::jthread> threads;
+
+    bool tryPop(sz worker, Task& out)
+    {
+        {
+            Worker& own = *this->workers[*worker];
+            const std::unique_lock guard(own.lock);
+            if (!own.tasks.empty())
+            {
+                out = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                --this->queued;
+                return true;
+            }
+        }
+
+        for (sz i = 1_uz; i < this->workers.size(); i++)
+        {
+            Worker& victim = *this->workers[*((worker + i) % this->workers.size())];
+            const std::unique_lock guard(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                out = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                --this->queued;
+                return true;
+            }
+        }
+
+        return false;
+    }
+    void run(std::stop_token token, sz worker)
+    {
+        WorkStealingPool::currentPool = this;
+        WorkStealingPool::currentWorker = worker;
+
+        Task task;
+        while (!token.stop_requested())
+        {
+            if (!this->tryPop(worker, task))
+            {
+                std::unique_lock guard(this->idleLock);
+                this->idleCv.wait(guard, token, [this] { return this->queued.load() > 0; });
+                continue;
+            }
+
+            task(*this, worker);
+            task = nullptr;
+
+            if (--this->pending == 0)
+            {
+                const std::unique_lock guard(this->doneLock);
+                this->doneCv.notify_all();
+            }
+        }
+    }
+public:
+    /// @param threadCount Number of workers, `0` for the hardware concurrency.
+    explicit WorkStealingPool(sz threadCount = 0_uz)
+    {
+        if (threadCount == 0_uz)
+            threadCount = std::max(1_uz, sz(std::thread::hardware_concurrency()));
+
+        this->workers.reserve(*threadCount);
+        for (sz i = 0_uz; i < threadCount; i++)
+            this->workers.emplace_back(std::make_unique<Worker>());
+        this->threads.reserve(*threadCount);
+        for (sz i = 0_uz; i < threadCount; i++)
+            this->threads.emplace_back([this, i](std::stop_token token) { this->run(std::move(token), i); });
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool(WorkStealingPool&&) = delete;
+    ~WorkStealingPool()
+    {
+        for (std::jthread& thread : this->threads)
+            thread.request_stop();
+        this->idleCv.notify_all();
+    }
+
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool&&) = delete;
+
+    [[nodiscard]] sz size() const { return this->workers.size(); }
+
+    /// @brief Queue a task, onto the calling worker's own deque if called from inside this pool.
+    void submit(Task task)
+    {
+        const sz worker = WorkStealingPool::currentPool == this ? WorkStealingPool::currentWorker : sz(this->nextSubmit++ % this->workers.size());
+
+        ++this->pending;
+        {
+            Worker& target = *this->workers[*worker];
+            const std::unique_lock guard(target.lock);
+            target.tasks.emplace_back(std::move(task));
+            ++this->queued;
+        }
+        {
+            const std::unique_lock guard(this->idleLock); // Order the above against idle workers checking `queued`.
+        }
+        this->idleCv.notify_one();
+    }
+    /// @brief Block until every submitted task, including those submitted by tasks, has finished.
+    void wait()
+    {
+        std::unique_lock guard(this->doneLock);
+        this->doneCv.wait(guard, [this] { return this->pending.load() == 0; });
+    }
+    /// @brief Block until every submitted task has finished, or `timeout` elapses.
+    /// @return Whether every task has finished.
+    template <typename Rep, typename Period>
+    bool waitFor(std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock guard(this->doneLock);
+        return this->doneCv.wait_for(guard, timeout, [this] { return this->pending.load() == 0; });
+    }
+};
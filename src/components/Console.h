@@ -1,100 +1,351 @@
 #include <Preamble.h>
 
 #include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <initializer_list>
 #include <memory>
-#include <span>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <module/sys>
 
 #include <Exec.inl>
+#include <HitTest.h>
+#include <TextWidth.h>
 #include <Utility.h>
 
+/// @brief Console component, showing the command history.
+/// @note
+/// History entries are only (re-)wrapped once they're reached while laying out the window in view, so a width change costs a window's worth of wrapping rather
+/// than the whole history. Line breaks are only kept for entries in view, so memory follows the window rather than the history. Positions are kept as an entry
+/// and a line within it, so the view stays anchored to the same entry across reflows. Only the window in view is laid out, with the selection and scroll
+/// position tracked here rather than by a component per line, so render and event cost are independent of the length of the history. Lines are wrapped by
+/// display width between grapheme clusters, and each entry remembers its widest line, so an entry that never needed a soft break isn't re-wrapped as the width
+/// changes while it still fits.
 class ConsoleImpl : public ui::ComponentBase, public std::enable_shared_from_this<ConsoleImpl>
 {
-    std::vector<std::string> lastLines;
-    sz lastLinesSizeOld = 0_uz;
-    i32 lastLineWidth = 1_i32;
-    i32 selected = 0_i32, selectedOld = 0_i32;
+    static constexpr i32 WheelStep = 3_i32;
 
-    sz lastHistorySize = 0_uz;
+    struct Span
+    {
+        std::uint32_t begin;
+        std::uint32_t end;
+        bool output; // Whether in `Entry::output`, rather than `Entry::cmd`.
+    };
+    struct Layout
+    {
+        i32 width = 0_i32; // `0` if never wrapped.
+        sz bytes = 0_uz;   // Size of the entry when wrapped.
+        size_t widest = 0; // Columns of the widest line.
+        bool softBreaks = false;
+        std::vector<Span> lines;
+    };
+    struct Position
+    {
+        sz entry = 0_uz;
+        sz line = 0_uz;
+
+        friend auto operator<=>(const Position&, const Position&) = default;
+    };
+
+    std::unordered_map<size_t, Layout> layouts; // By history entry, only for entries around the window in view.
+    sz entries = 0_uz;                          // In the history, as of the last frame.
+    i32 lineWidth = 1_i32;
+    Position top, selected;
+    std::optional<Position> hovered;
+    bool follow = true; // Whether the selection sticks to the last line as output arrives.
+
+    RowHitTester rowHits;
+    i32 visibleRows = 0_i32; // From `top` onwards.
     ui::Box bounds;
 
-    void renderLastLines(const std::vector<CommandInvocation::Entry>& history)
+    [[nodiscard]] i32 viewHeight() const
+    {
+        // Before the first frame, assume the console gets the whole terminal.
+        const int height = this->bounds.y_max >= this->bounds.y_min ? this->bounds.y_max - this->bounds.y_min + 1 : ui::Terminal::Size().dimy;
+        return std::max(i32(height), 1_i32);
+    }
+
+    /// @brief Layout of entry `at`, wrapping it first if it's stale.
+    const Layout& layoutOf(sz at)
     {
-        i32 maxLineWidth = std::max(i32(this->bounds.x_max) - i32(this->bounds.x_min), i32::highest());
-        if (this->lastHistorySize > history.size() || this->lastLineWidth != maxLineWidth)
+        Layout& layout = this->layouts[*at];
+        const ConsoleHistory& history = CommandInvocation::rawHistory();
+        // Spilled entries aren't paged back in just to check.
+        const sz bytes = sz(history.bytesAt(*at));
+        const bool unchanged = layout.width != 0_i32 && layout.bytes == bytes;
+        _retif(layout, unchanged && layout.width == this->lineWidth);
+        if (unchanged && !layout.softBreaks && layout.widest <= *sz(this->lineWidth))
         {
-            this->containerComp->DetachAllChildren();
-            this->lastLines.clear();
-            this->lastHistorySize = 0_uz;
-            this->lastLineWidth = maxLineWidth;
+            layout.width = this->lineWidth; // Still fits unbroken, so wraps the same.
+            return layout;
         }
+        const std::shared_ptr<const CommandInvocation::Entry> entry = history[*at];
 
-        this->lastLinesSizeOld = this->lastLines.size();
-        for (const auto& entry : std::span(history.begin() + *ssz(this->lastHistorySize), history.end()))
+        layout.width = this->lineWidth;
+        layout.bytes = bytes;
+        layout.widest = 0;
+        layout.softBreaks = false;
+        layout.lines.clear();
+        std::vector<TextWidth::Line> wrapped;
+        for (const bool output : { false, true })
         {
-            const auto process = [&](const std::string& text)
+            wrapped.clear();
+            TextWidth::wrap(output ? entry->output : entry->cmd, *sz(this->lineWidth), wrapped);
+            for (const TextWidth::Line& line : wrapped)
             {
-                if (text.empty())
-                    return;
+                layout.lines.emplace_back(Span { .begin = _as(std::uint32_t, line.begin), .end = _as(std::uint32_t, line.end), .output = output });
+                layout.widest = std::max(layout.widest, line.columns);
+                layout.softBreaks |= line.soft;
+            }
+        }
+        return layout;
+    }
+    [[nodiscard]] std::string textOf(Position pos)
+    {
+        const Span span = this->layoutOf(pos.entry).lines[*pos.line];
+        const std::shared_ptr<const CommandInvocation::Entry> entry = CommandInvocation::rawHistory()[*pos.entry];
+        return (span.output ? entry->output : entry->cmd).substr(span.begin, span.end - span.begin);
+    }
 
-                wstringSplitLengthConstrained(text, sz(maxLineWidth), this->lastLines);
-            };
+    /// @brief Move `pos` `count` lines forwards (or backwards, if negative), skipping entries with no lines.
+    /// @return How many lines it actually moved, short of `count` when reaching either end.
+    i32 advance(Position& pos, i32 count)
+    {
+        i32 moved = 0_i32;
+        for (; count > 0_i32; --count, ++moved)
+        {
+            if (pos.line + 1_uz < this->layoutOf(pos.entry).lines.size())
+            {
+                ++pos.line;
+                continue;
+            }
 
-            process(entry.cmd);
-            process(entry.output);
+            sz next = pos.entry + 1_uz;
+            while (next < this->entries && this->layoutOf(next).lines.empty())
+                ++next;
+            _retif(moved, next >= this->entries);
+            pos = Position { .entry = next, .line = 0_uz };
         }
+        for (; count < 0_i32; ++count, --moved)
+        {
+            if (pos.line > 0_uz)
+            {
+                --pos.line;
+                continue;
+            }
+
+            sz prev = pos.entry;
+            do
+            {
+                _retif(moved, prev == 0_uz);
+                --prev;
+            } while (this->layoutOf(prev).lines.empty());
+            pos = Position { .entry = prev, .line = this->layoutOf(prev).lines.size() - 1_uz };
+        }
+        return moved;
+    }
+    /// @brief Bring `pos` back to a line that exists, after wrapping or the history changed.
+    void normalize(Position& pos)
+    {
+        _retif(, this->entries == 0_uz);
+        if (pos.entry >= this->entries)
+        {
+            pos = this->lastLine();
+            return;
+        }
+
+        const sz count = this->layoutOf(pos.entry).lines.size();
+        if (count != 0_uz)
+        {
+            pos.line = std::min(pos.line, count - 1_uz);
+            return;
+        }
+
+        // On an entry without lines, so settle on the nearest line before it, or else after it.
+        pos.line = 0_uz;
+        if (this->advance(pos, i32(-1)) == 0_i32)
+            (void)this->advance(pos, 1_i32);
+    }
+    [[nodiscard]] Position lastLine()
+    {
+        Position ret { .entry = this->entries - 1_uz, .line = 0_uz };
+        const sz count = this->layoutOf(ret.entry).lines.size();
+        if (count != 0_uz)
+            ret.line = count - 1_uz;
+        else
+            this->normalize(ret);
+        return ret;
     }
-    void syncLineComponents(const std::vector<CommandInvocation::Entry>& history)
+    /// @brief Scroll so `selected` is in view, and the view isn't scrolled past the last line.
+    void clampScroll()
     {
-        const bool follow = (this->selected >= i32(this->containerComp->ChildCount()) - 1_i32) || (this->containerComp->ChildCount() == 0_uz);
+        this->normalize(this->selected);
+        this->normalize(this->top);
+        if (this->selected < this->top)
+            this->top = this->selected;
+        else
+        {
+            Position probe = this->top;
+            for (i32 i = 1_i32; i < this->viewHeight() && probe < this->selected; i++)
+                (void)this->advance(probe, 1_i32);
+            if (probe < this->selected)
+            {
+                this->top = this->selected;
+                (void)this->advance(this->top, 1_i32 - this->viewHeight());
+            }
+        }
 
-        for (sz i = this->lastLinesSizeOld; i < this->lastLines.size(); i++)
-            this->containerComp->Add(this->createRow(this->lastLines[i]));
+        Position bottom = this->top;
+        const i32 below = this->advance(bottom, this->viewHeight() - 1_i32);
+        if (below < this->viewHeight() - 1_i32)
+            (void)this->advance(this->top, below - (this->viewHeight() - 1_i32));
+    }
+
+    /// @brief Bring the view up to date with the history, and with the console's width.
+    void syncLayouts(const ConsoleHistory& history)
+    {
+        const int boundsWidth = this->bounds.x_max >= this->bounds.x_min ? this->bounds.x_max - this->bounds.x_min : ui::Terminal::Size().dimx;
+        const i32 width = std::max(i32(boundsWidth), 1_i32); // Less a column for the scrollbar.
+        if (this->entries > history.size()) // Cleared.
+        {
+            this->layouts.clear();
+            this->top = this->selected = Position {};
+            this->follow = true;
+        }
+        this->lineWidth = width; // Entries re-wrap themselves lazily once reached.
+        this->entries = sz(history.size());
+        _retif(, this->entries == 0_uz);
 
-        this->lastHistorySize = history.size();
+        if (this->follow)
+            this->selected = this->lastLine();
+        this->clampScroll();
+    }
 
-        if (follow && !this->lastLines.empty())
-            this->selected = i32(this->lastLines.size()) - 1_i32;
+    /// @brief Forget the layouts of entries outside `first` to `last`, other than the selected one's, to be wrapped again if they come back into view.
+    void dropLayoutsOutside(sz first, sz last)
+    {
+        std::erase_if(this->layouts, [&](const auto& layout) { return (layout.first < *first || layout.first > *last) && layout.first != *this->selected.entry; });
     }
 
-    [[nodiscard]] ui::Element postProcessRow(const ui::EntryState& state)
+    [[nodiscard]] ui::Element renderLine(Position pos, bool focused)
     {
-        ui::Element ret = ui::text(state.label);
-        if (state.index == this->selected) // Circumvent native behaviour of unselecting when console not focused.
-            ret = ret | ui::bold | ui::focus;
-        if (state.active)
+        ui::Element ret = ui::text(this->textOf(pos));
+        const bool isHovered = this->hovered == pos;
+        if (pos == this->selected)
+            ret |= ui::bold;
+        if ((focused && pos == this->selected) || isHovered)
             ret |= ui::underlined;
-        if (!state.active && state.index != this->selected)
+        if (pos != this->selected && !isHovered)
             ret |= ui::dim;
         return ret;
     }
-    [[nodiscard]] ui::Component createRow(std::string str)
+    [[nodiscard]] ui::Element renderScrollbar() const
     {
-        return ui::MenuEntry(std::move(str),
-                             ui::MenuEntryOption { .transform = [this](const ui::EntryState& state) -> ui::Element { return this->postProcessRow(state); },
-                                                   .animated_colors = ui::AnimatedColorsOption() });
+        // Positioned by entry rather than line, since only entries in view are known to be wrapped.
+        const i32 height = this->viewHeight();
+        const i32 count(this->entries);
+        _retif(ui::emptyElement(), count <= 1_i32 || (this->top == Position {} && this->visibleRows < height));
+
+        const i32 thumbTop = std::min(i32(this->top.entry) * height / count, height - 1_i32);
+        ui::Elements ret;
+        for (i32 i = 0_i32; i < height; i++)
+            ret.emplace_back(ui::text(i == thumbTop ? "┃" : " "));
+        return ui::vbox(std::move(ret));
     }
 
-    ui::Component containerComp = ui::Container::Vertical({}, &*this->selected);
-    ui::Component displayComp = ui::Renderer(this->containerComp, [this]() -> ui::Element
+    bool onEvent(const ui::Event& event)
     {
-        const auto internalRender = [&]() -> ui::Element
-        { return (this->lastLines.empty() ? ui::text("<empty>") | ui::center : this->containerComp->Render()) | ui::vscroll_indicator | ui::yframe | ui::reflect(this->bounds); };
+        _retif(false, this->entries == 0_uz);
 
-        const std::vector<CommandInvocation::Entry>& history = CommandInvocation::rawHistory();
-        _retif(internalRender(), this->lastHistorySize == history.size());
+        if (event.is_mouse())
+        {
+            if (!this->bounds.Contain(event.mouse().x, event.mouse().y))
+            {
+                this->hovered = std::nullopt;
+                return false;
+            }
+
+            if (event.mouse().button == ui::Mouse::WheelUp || event.mouse().button == ui::Mouse::WheelDown)
+            {
+                (void)this->advance(this->top, event.mouse().button == ui::Mouse::WheelUp ? 0_i32 - ConsoleImpl::WheelStep : ConsoleImpl::WheelStep);
+                Position bottom = this->top;
+                const i32 below = this->advance(bottom, this->viewHeight() - 1_i32);
+                if (below < this->viewHeight() - 1_i32)
+                    (void)this->advance(this->top, below - (this->viewHeight() - 1_i32));
+                return true;
+            }
+            if (event.mouse().motion != ui::Mouse::Moved && (event.mouse().button != ui::Mouse::Left || event.mouse().motion != ui::Mouse::Pressed))
+                return false;
 
-        this->renderLastLines(history);
-        this->syncLineComponents(history);
+            sys::result<sz> found = this->rowHits.rowAt(event.mouse().y - this->bounds.y_min, sz(this->visibleRows));
+            _retif(false, !found);
 
-        return internalRender();
-    });
+            Position pos = this->top;
+            (void)this->advance(pos, i32(found.move()));
+            if (event.mouse().motion == ui::Mouse::Moved)
+                this->hovered = pos;
+            else
+            {
+                this->selected = pos;
+                this->follow = this->selected == this->lastLine();
+                this->displayComp->TakeFocus();
+            }
+            return true;
+        }
+
+        const Position old = this->selected;
+        if (event == ui::Event::ArrowUp)
+            (void)this->advance(this->selected, i32(-1));
+        else if (event == ui::Event::ArrowDown)
+            (void)this->advance(this->selected, 1_i32);
+        else if (event == ui::Event::PageUp)
+            (void)this->advance(this->selected, 0_i32 - this->viewHeight());
+        else if (event == ui::Event::PageDown)
+            (void)this->advance(this->selected, this->viewHeight());
+        else if (event == ui::Event::Home)
+        {
+            this->selected = Position {};
+            this->normalize(this->selected);
+        }
+        else if (event == ui::Event::End)
+            this->selected = this->lastLine();
+        else
+            return false;
+
+        this->follow = this->selected == this->lastLine();
+        this->clampScroll();
+        return this->selected != old;
+    }
+
+    ui::Component displayComp = ui::Renderer([this](bool focused) -> ui::Element
+    {
+        this->syncLayouts(CommandInvocation::rawHistory());
+
+        ui::Elements rows;
+        if (this->entries != 0_uz && !this->layoutOf(this->top.entry).lines.empty())
+        {
+            Position pos = this->top;
+            do
+                rows.emplace_back(this->renderLine(pos, focused));
+            while (i32(rows.size()) < this->viewHeight() && this->advance(pos, 1_i32) == 1_i32);
+            this->dropLayoutsOutside(this->top.entry, pos.entry);
+        }
+        this->visibleRows = i32(rows.size());
+        _retif(ui::text("<empty>") | ui::center | ui::yflex | ui::reflect(this->bounds), rows.empty());
+
+        return ui::hbox({ ui::vbox(std::move(rows)) | ui::xflex, this->renderScrollbar() }) | ui::yflex | ui::reflect(this->bounds);
+    }) | ui::CatchEvent([this](const ui::Event& event) { return this->onEvent(event); });
 public:
-    explicit ConsoleImpl() { this->Add(this->displayComp); }
+    explicit ConsoleImpl()
+    {
+        this->rowHits.uniform(1); // Lines are single `ui::text`s.
+        this->Add(this->displayComp);
+    }
 };
 
 inline ui::Component /* NOLINT(readability-identifier-naming) */ Console() { return ui::Make<ConsoleImpl>(); }
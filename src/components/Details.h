@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Preamble.h>
+
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <module/sys>
+
+#include <Metadata.h>
+#include <Music.h>
+
+/// @brief Details pane showing the tags of the current track.
+class DetailsImpl : public ui::ComponentBase, public std::enable_shared_from_this<DetailsImpl>
+{
+    static ui::Element field(std::string_view label, const std::string& value)
+    {
+        return ui::hbox({ ui::text(std::string(label)) | ui::dim, ui::paragraphAlignLeft(value.empty() ? "-" : value) | ui::xflex });
+    }
+
+    ui::Component displayComp = ui::Renderer([]
+    {
+        const std::shared_ptr<const MusicPlayer::PlaylistSnapshot> playlist = MusicPlayer::currentPlaylist();
+        if (MusicPlayer::currentTrack < 0_i32 || MusicPlayer::currentTrack >= playlist->tracks.size())
+            return ui::text("<nothing playing>") | ui::dim | ui::center;
+
+        const MusicPlayer::FoundMusic& track = playlist->tracks[sz(MusicPlayer::currentTrack)];
+        const std::shared_ptr<const TrackMetadata> meta = MetadataStore::find(track);
+        if (!meta)
+            return ui::vbox({ ui::paragraphAlignLeft(track.name) | ui::bold, ui::text("reading tags...") | ui::dim });
+
+        return ui::vbox({
+            ui::paragraphAlignLeft(meta->title.empty() ? track.name : meta->title) | ui::bold,
+            ui::separatorEmpty(),
+            DetailsImpl::field("artist ", meta->artist),
+            DetailsImpl::field("album  ", meta->album),
+            DetailsImpl::field("genre  ", meta->genre),
+            DetailsImpl::field("length ", meta->duration > 0_i32 ? MusicPlayer::formatTime(_as(float, *meta->duration)) : ""),
+            DetailsImpl::field("bitrate", meta->bitrate > 0_i32 ? std::format("{} kbit/s", *meta->bitrate) : ""),
+        });
+    });
+public:
+    DetailsImpl() { this->Add(this->displayComp); }
+};
+
+/// @brief Create a details pane component.
+inline ui::Component /* NOLINT(readability-identifier-naming) */ Details() { return ui::Make<DetailsImpl>(); }
@@ -3,7 +3,6 @@
 #include <Preamble.h>
 
 #include <algorithm>
-#include <iterator>
 #include <memory>
 #include <string>
 #include <utility>
@@ -11,123 +10,210 @@
 
 #include <module/sys>
 
+#include <HitTest.h>
+#include <Metadata.h>
 #include <Music.h>
 
+/// @brief Playlist component.
+/// @note
+/// Virtualized: only the rows in view are labelled and laid out, so frame cost is independent of the length of the playlist. Labels are kept until the playlist
+/// or metadata generation moves on, and those of rows still in view are kept across scrolling. Rows are single lines, long names being clipped rather than
+/// wrapped, so they can be hit-tested arithmetically.
 class PlaylistImpl : public ui::ComponentBase, public std::enable_shared_from_this<PlaylistImpl>
 {
-    std::vector<std::string> trackNames;
-    std::vector<ui::Box> itemBounds;
-    i32 hovered = 0_i32, highlighted = 0_i32;
+    friend struct Bench;
 
-    ui::Element postProcessEntry(const ui::EntryState& state)
+    static constexpr i32 WheelStep = 3_i32;
+
+    using Source = std::shared_ptr<const MusicPlayer::PlaylistSnapshot> (*)();
+    Source source = &MusicPlayer::currentPlaylist; // Where the shown playlist comes from, swapped out only to benchmark against playlists of other lengths.
+
+    std::vector<std::string> rowLabels; // Labels of `rowsFrom` up to `rowsTo`, the rows last in view.
+    i32 rowsFrom = 0_i32, rowsTo = 0_i32;
+    size_t labelledPlaylist = 0, labelledMetadata = 0; // Generations `rowLabels` were made at.
+    RowHitTester rowHits;
+    i32 visibleRows = 0_i32; // From `scrollTop` onwards.
+    ui::Box rowsBounds;
+    i32 hovered = i32::sentinel(), highlighted = 0_i32;
+    i32 scrollTop = 0_i32;
+    ui::Box bounds;
+
+    [[nodiscard]] i32 viewHeight() const
     {
-        if (this->itemBounds.size() < this->trackNames.size())
-        {
-            sz cap = 32_uz; // NOLINT(readability-magic-numbers)
-            while ((cap = std::max(cap, sz(this->itemBounds.capacity()))) < this->trackNames.size())
-                cap *= 2_uz;
-            this->itemBounds.reserve(cap);
-            this->itemBounds.resize(this->trackNames.size());
-        }
+        // Before the first frame, assume the list gets the whole terminal.
+        const int height = this->bounds.y_max >= this->bounds.y_min ? this->bounds.y_max - this->bounds.y_min + 1 : ui::Terminal::Size().dimy;
+        return std::max(i32(height), 1_i32);
+    }
+    void clampScroll()
+    {
+        const i32 size(this->source()->tracks.size());
+        this->highlighted = std::clamp(this->highlighted, 0_i32, std::max(size - 1_i32, 0_i32));
+        if (this->highlighted < this->scrollTop)
+            this->scrollTop = this->highlighted;
+        else if (this->highlighted >= this->scrollTop + this->viewHeight())
+            this->scrollTop = this->highlighted - this->viewHeight() + 1_i32;
+        this->scrollTop = std::clamp(this->scrollTop, 0_i32, std::max(size - this->viewHeight(), 0_i32));
+    }
 
-        ui::Element ret = ui::paragraphAlignLeft(state.label);
+    [[nodiscard]] ui::Element renderRow(i32 index, const std::string& label, bool focused) const
+    {
+        const bool active = focused && index == this->highlighted;
+        ui::Element ret = ui::text(label);
 
-        if (state.index == MusicPlayer::currentTrack)
+        if (index == MusicPlayer::currentTrack)
             ret |= ui::inverted;
-        else if (state.index == this->hovered)
+        else if (index == this->hovered)
             ret |= ui::underlined;
 
-        if (state.active)
+        if (active)
             ret |= ui::bold;
-        else if (state.index != this->hovered && state.index != MusicPlayer::currentTrack)
+        else if (index != this->hovered && index != MusicPlayer::currentTrack)
             ret |= ui::dim;
 
         return ui::hbox({ ui::text(
                               [&]
         {
-            if (state.index == MusicPlayer::currentTrack)
+            if (index == MusicPlayer::currentTrack)
                 return "> ";
-            if (state.active)
+            if (active)
                 return "* ";
             return "  ";
         }()),
-                          ret }) |
-            ui::reflect(this->itemBounds[sz(state.index)]);
+                          std::move(ret) });
+    }
+    [[nodiscard]] ui::Element renderScrollbar(i32 size) const
+    {
+        const i32 height = this->viewHeight();
+        _retif(ui::emptyElement(), size <= height);
+
+        const i32 thumbSize = std::max(height * height / size, 1_i32);
+        const i32 thumbTop = std::min(this->scrollTop * height / size, height - thumbSize);
+        ui::Elements ret;
+        for (i32 i = 0_i32; i < height; i++)
+            ret.emplace_back(ui::text(i >= thumbTop && i < thumbTop + thumbSize ? "┃" : " "));
+        return ui::vbox(std::move(ret));
     }
+
     void onEntryEnter()
     {
         MusicPlayer::currentTrack = this->highlighted;
         (void)MusicPlayer::play();
     }
-
-    ui::Component menuComp =
-        ui::Menu(&this->trackNames, &*this->highlighted,
-                 ui::MenuOption {
-                     .entries {},
-                     .underline = ui::UnderlineOption {},
-                     .entries_option = ui::MenuEntryOption { .label = "",
-                               .transform = [this](const ui::EntryState& state) -> ui::Element { return this->postProcessEntry(state); },
-                               .animated_colors {} },
-                     .elements_prefix {},
-                     .elements_infix {},
-                     .elements_postfix {},
-                     .on_change {},
-                     .on_enter = [this] { this->onEntryEnter(); }
-    }) |
-        ui::CatchEvent([this](ui::Event event) -> bool
+    bool onEvent(const ui::Event& event)
     {
-        if (this->itemBounds.size() > this->trackNames.size())
-            this->itemBounds.erase(this->itemBounds.begin() + ssz(this->trackNames.size()));
-
-        if (!event.is_mouse() || !this->bounds.Contain(event.mouse().x, event.mouse().y))
-            return false;
-
-        if (event.mouse().motion != ui::Mouse::Moved && (event.mouse().button != ui::Mouse::Left || event.mouse().motion != ui::Mouse::Pressed))
-            return false;
-
-        const ssz foundIndex =
-            std::distance(this->itemBounds.begin(), std::ranges::find_if(this->itemBounds, [&](const ui::Box& box) { return box.Contain(event.mouse().x, event.mouse().y); }));
-        if (foundIndex >= this->itemBounds.size())
-            return false;
+        const i32 size(this->source()->tracks.size());
+        if (event.is_mouse())
+        {
+            if (!this->bounds.Contain(event.mouse().x, event.mouse().y))
+            {
+                this->hovered = i32::sentinel();
+                return false;
+            }
+
+            if (event.mouse().button == ui::Mouse::WheelUp || event.mouse().button == ui::Mouse::WheelDown)
+            {
+                const i32 scrolled = event.mouse().button == ui::Mouse::WheelUp ? this->scrollTop - PlaylistImpl::WheelStep : this->scrollTop + PlaylistImpl::WheelStep;
+                this->scrollTop = std::clamp(scrolled, 0_i32, std::max(size - this->viewHeight(), 0_i32));
+                return true;
+            }
+            if (event.mouse().motion != ui::Mouse::Moved && (event.mouse().button != ui::Mouse::Left || event.mouse().motion != ui::Mouse::Pressed))
+                return false;
+
+            sys::result<sz> found = this->rowHits.rowAt(event.mouse().y - this->rowsBounds.y_min, sz(this->visibleRows));
+            if (!this->rowsBounds.Contain(event.mouse().x, event.mouse().y) || !found)
+                return false;
+
+            const i32 index = this->scrollTop + i32(found.move());
+            if (event.mouse().motion == ui::Mouse::Moved)
+                this->hovered = index;
+            else
+            {
+                this->highlighted = index;
+                this->displayComp->TakeFocus();
+            }
+            return true;
+        }
 
-        if (event.mouse().motion == ui::Mouse::Moved)
-            this->hovered = i32(foundIndex);
-        else
+        if (event == ui::Event::Return)
         {
-            this->highlighted = i32(foundIndex);
-            this->menuComp->TakeFocus();
+            this->onEntryEnter();
+            return true;
         }
 
-        return true;
-    });
+        const i32 old = this->highlighted;
+        if (event == ui::Event::ArrowUp)
+            --this->highlighted;
+        else if (event == ui::Event::ArrowDown)
+            ++this->highlighted;
+        else if (event == ui::Event::PageUp)
+            this->highlighted -= this->viewHeight();
+        else if (event == ui::Event::PageDown)
+            this->highlighted += this->viewHeight();
+        else if (event == ui::Event::Home)
+            this->highlighted = 0_i32;
+        else if (event == ui::Event::End)
+            this->highlighted = size - 1_i32;
+        else
+            return false;
+
+        this->clampScroll();
+        return this->highlighted != old;
+    }
 
     i32 currentTrackOld = MusicPlayer::currentTrack;
-    ui::Box bounds;
-    ui::Component displayComp = ui::Renderer(this->menuComp, [this]
+    ui::Component displayComp = ui::Renderer([this](bool focused)
     {
         if (this->currentTrackOld != MusicPlayer::currentTrack)
         {
-            this->highlighted = i32(MusicPlayer::currentTrack);
+            this->highlighted = MusicPlayer::currentTrack;
             this->currentTrackOld = MusicPlayer::currentTrack;
+            this->clampScroll();
         }
 
-        const std::vector<MusicPlayer::FoundMusic>& playlist = MusicPlayer::currentPlaylist();
-        if (this->trackNames.size() > playlist.size())
-            this->trackNames.erase(this->trackNames.begin() + *ssz(playlist.size()));
-        for (sz i = 0_uz; i < this->trackNames.size(); i++)
-            this->trackNames[i] = playlist[i].name;
-        while (this->trackNames.size() < playlist.size())
+        const std::shared_ptr<const MusicPlayer::PlaylistSnapshot> playlist = this->source();
+        const i32 size(playlist->tracks.size());
+        this->scrollTop = std::clamp(this->scrollTop, 0_i32, std::max(size - this->viewHeight(), 0_i32));
+        const i32 visibleTo = std::min(this->scrollTop + this->viewHeight(), size);
+
+        // Label the visible window, reusing the labels of rows that were already in view. Nothing outside it is touched.
+        const size_t metadata = MetadataStore::generation();
+        if (this->labelledPlaylist != playlist->generation || this->labelledMetadata != metadata)
         {
-            std::string str = playlist[this->trackNames.size()].name;
-            this->trackNames.emplace_back(std::move(str));
+            this->rowLabels.clear();
+            this->rowsFrom = this->rowsTo = 0_i32;
+            this->labelledPlaylist = playlist->generation;
+            this->labelledMetadata = metadata;
         }
+        if (this->rowsFrom != this->scrollTop || this->rowsTo != visibleTo)
+        {
+            std::vector<std::string> labels;
+            labels.reserve(_as(size_t, *std::max(visibleTo - this->scrollTop, 0_i32)));
+            for (i32 i = this->scrollTop; i < visibleTo; i++)
+                labels.emplace_back(i >= this->rowsFrom && i < this->rowsTo ? std::move(this->rowLabels[sz(i - this->rowsFrom)]) : MetadataStore::label(playlist->tracks[sz(i)]));
+            this->rowLabels = std::move(labels);
+            this->rowsFrom = this->scrollTop;
+            this->rowsTo = visibleTo;
+        }
+
+        this->visibleRows = std::max(visibleTo - this->scrollTop, 0_i32);
+        ui::Elements rows;
+        for (i32 i = this->scrollTop; i < visibleTo; i++)
+            rows.emplace_back(this->renderRow(i, this->rowLabels[sz(i - this->rowsFrom)], focused));
 
-        return this->menuComp->Render() | ui::vscroll_indicator | ui::yframe | ui::yflex | ui::reflect(this->bounds);
-    });
+        return ui::hbox({ ui::vbox(std::move(rows)) | ui::xflex | ui::reflect(this->rowsBounds), this->renderScrollbar(size) }) | ui::yflex | ui::reflect(this->bounds);
+    }) | ui::CatchEvent([this](const ui::Event& event) { return this->onEvent(event); });
+
+    /// @brief A playlist showing `source` instead, left untouched until rendered or sent events, and so safe to build off the UI thread.
+    explicit PlaylistImpl(Source source) : source(source), currentTrackOld(i32::sentinel())
+    {
+        this->rowHits.uniform(1);
+        this->Add(this->displayComp);
+    }
 public:
     PlaylistImpl()
     {
-        if (MusicPlayer::currentPlaylist().empty())
+        this->rowHits.uniform(1); // Rows are single `ui::text` lines.
+        if (MusicPlayer::currentPlaylist()->tracks.empty())
             MusicPlayer::generateShuffledPlaylist();
 
         this->Add(this->displayComp);
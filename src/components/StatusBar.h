@@ -3,16 +3,17 @@
 #include <Preamble.h>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
+#include <cstdint>
 #include <format>
 #include <ftxui/component/captured_mouse.hpp>
 #include <ftxui/component/component.hpp>
 #include <memory>
 #include <mutex>
-#include <stop_token>
 #include <string>
-#include <thread>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -21,7 +22,10 @@
 #include <Config.h>
 #include <Exec.inl>
 #include <Music.h>
+#include <RenderScheduler.h>
+#include <Scheduler.h>
 #include <Screen.h>
+#include <Trace.h>
 #include <Utility.h>
 
 /// @brief Status bar component that displays temporary messages and track progress.
@@ -30,50 +34,54 @@
 /// Pass `byptr`.
 class StatusBarImpl : public ui::ComponentBase, public std::enable_shared_from_this<StatusBarImpl>
 {
+    static constexpr std::array<std::string_view, 1> ButtonArgv { "[invoked by button press]" };
+
     ui::ScreenInteractive& screen = Screen(); // NOLINT(cppcoreguidelines-avoid-const-or-ref-data-members)
 
     std::string message;
     std::chrono::steady_clock::time_point messageExpiry = std::chrono::steady_clock::time_point::min();
     std::mutex messageLock;
-    std::condition_variable_any messageCv;
-    std::jthread messageThread { [this](std::stop_token token)
-    {
-        while (!token.stop_requested())
-        {
-            std::unique_lock guard(this->messageLock);
-            if (this->messageExpiry == std::chrono::steady_clock::time_point::min())
-            {
-                this->messageCv.wait(guard, token, [this] { return this->messageExpiry != std::chrono::steady_clock::time_point::min(); });
-                if (token.stop_requested())
-                    break;
-            }
+    Timer messageTimer;
+    Timer progressTimer; // Only while playing, so a paused or stopped player never wakes up to redraw.
+    std::atomic<std::uint64_t> shownProgress = 0; // `progressKey` of the last progress drawn.
+    std::atomic<int> sliderWidth = 0;
 
-            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
-            if (now < this->messageExpiry)
-            {
-                this->messageCv.wait_until(guard, token, this->messageExpiry, [this] { return std::chrono::steady_clock::now() >= this->messageExpiry; });
-                continue;
-            }
+    /// @brief Everything the progress display shows that changes as a track plays, the elapsed seconds and the filled cells, packed together.
+    [[nodiscard]] static std::uint64_t progressKey(float current, float total, int width)
+    {
+        const auto filled = _as(std::uint64_t, total > 0.0f ? current / total * _as(float, width) : 0.0f);
+        return (_as(std::uint64_t, current) << 32u) | filled; // NOLINT(readability-magic-numbers)
+    }
 
+    void expireMessage()
+    {
+        _trace_scope("message expiry");
+        {
+            const std::unique_lock guard(this->messageLock);
+            _retif(, this->messageExpiry == std::chrono::steady_clock::time_point::min() || std::chrono::steady_clock::now() < this->messageExpiry);
             this->message.clear();
             this->messageExpiry = std::chrono::steady_clock::time_point::min();
-            this->screen.PostEvent(ui::Event::Custom);
         }
-    } };
-
-    std::jthread progressThread { [](std::stop_token token)
+        RenderScheduler::request();
+    }
+    /// @brief Start ticking the progress display if a track started playing since it last stopped.
+    void syncProgressTimer()
     {
-        while (!token.stop_requested())
+        _retif(, !MusicPlayer::playing() || !MusicPlayer::loaded() || this->progressTimer.pending());
+        // Ticks finer than a second, to keep the slider smooth on wide terminals, but only redraws when a tick changed what's shown.
+        this->progressTimer = Scheduler::every(Config::StatusBarDurationRefreshRate, [this]
         {
-            if (MusicPlayer::playing() && MusicPlayer::loaded())
+            _trace_scope("progress tick");
+            _retif(false, !MusicPlayer::playing() || !MusicPlayer::loaded());
+            // The track is only safe to look at from the UI thread, and a task posted there doesn't redraw by itself.
+            Screen().Post([this]
             {
-                Screen().PostEvent(ui::Event::Custom);
-                std::this_thread::sleep_for(Config::StatusBarDurationRefreshRate);
-            }
-            else
-                std::this_thread::sleep_for(Config::StatusBarDurationRefreshRateInactive);
-        }
-    } };
+                RenderScheduler::requestIfChanged(this->shownProgress,
+                                                  StatusBarImpl::progressKey(MusicPlayer::currentTime(), MusicPlayer::totalTime(), this->sliderWidth.load()));
+            });
+            return true;
+        });
+    }
 
     ui::Element /* NOLINT(readability-convert-member-functions-to-static) */ postProcessButton(ui::Element elem, const ui::EntryState& state)
     {
@@ -89,7 +97,7 @@ class StatusBarImpl : public ui::ComponentBase, public std::enable_shared_from_t
     ui::Component playPauseButton = ui::Button("Play",
                                                []
     {
-        if (!MusicPlayer::loaded())
+        if (!MusicPlayer::loadedOrLoading())
         {
             if (!MusicPlayer::play())
                 CommandInvocation::println("[log.error] Failed to play track.");
@@ -108,14 +116,14 @@ class StatusBarImpl : public ui::ComponentBase, public std::enable_shared_from_t
     },
                                                ui::ButtonOption { .transform = [this](const ui::EntryState& state) -> ui::Element
     {
-        return this->postProcessButton(MusicPlayer::playing() && MusicPlayer::loaded() ? ui::text(UserSettings::PauseButtonLabel) : ui::text(UserSettings::PlayButtonLabel), state);
+        return this->postProcessButton(MusicPlayer::playing() && MusicPlayer::loadedOrLoading() ? ui::text(UserSettings::PauseButtonLabel) : ui::text(UserSettings::PlayButtonLabel), state);
     },
                                                                   .animated_colors {} });
-    ui::Component stopButton = ui::Button("Stop", [] { CommandInvocation::stop({ "[invoked by button press]" }); },
+    ui::Component stopButton = ui::Button("Stop", [] { CommandInvocation::stop(StatusBarImpl::ButtonArgv); },
                                           ui::ButtonOption { .transform = [this](const ui::EntryState& state) -> ui::Element
     { return this->postProcessButton(ui::text(UserSettings::StopButtonLabel), state); },
                                                              .animated_colors {} });
-    ui::Component nextButton = ui::Button("Next", [] { CommandInvocation::next({ "[invoked by button press]" }); },
+    ui::Component nextButton = ui::Button("Next", [] { CommandInvocation::next(StatusBarImpl::ButtonArgv); },
                                           ui::ButtonOption { .transform = [this](const ui::EntryState& state) -> ui::Element
     { return this->postProcessButton(ui::text(UserSettings::NextButtonLabel), state); },
                                                              .animated_colors {} });
@@ -124,24 +132,28 @@ class StatusBarImpl : public ui::ComponentBase, public std::enable_shared_from_t
     ui::Box sliderBounds;
     ui::Component progressSliderComp = ui::Renderer([this]
     {
+        this->syncProgressTimer();
         {
             const std::unique_lock guard(this->messageLock);
             if (!this->message.empty())
                 return ui::text(this->message);
         }
+        if (const std::string_view loading = MusicPlayer::loadingTrack(); !loading.empty())
+            return ui::text(std::format("Loading `{}`...", loading));
 
+        const float current = MusicPlayer::currentTime();
+        const float total = MusicPlayer::totalTime();
         if (MusicPlayer::loaded())
-        {
-            const float total = MusicPlayer::totalTime();
-            this->trackProgress = (total > 0.0f) ? (MusicPlayer::currentTime() / total) : 0.0f;
-        }
+            this->trackProgress = (total > 0.0f) ? (current / total) : 0.0f;
         else
             this->trackProgress = 0.0f;
 
         const i32 totalWidth = std::max(0_i32, i32(this->sliderBounds.x_max) - i32(this->sliderBounds.x_min) + 1_i32);
         const i32 filledWidth = i32(this->trackProgress * _as(float, totalWidth));
+        this->sliderWidth = *totalWidth;
+        this->shownProgress = StatusBarImpl::progressKey(current, total, *totalWidth);
 
-        return ui::hbox({ ui::text(std::format("{} / {}", MusicPlayer::formatTime(MusicPlayer::currentTime()), MusicPlayer::formatTime(MusicPlayer::totalTime()))),
+        return ui::hbox({ ui::text(std::format("{} / {}", MusicPlayer::formatTime(current), MusicPlayer::formatTime(total))),
                           ui::separatorEmpty(),
                           ui::hbox({
                               ui::separatorCharacter(UserSettings::ProgressBarFill) | ui::color(UserSettings::FlavorEmphasizedColor) | ui::size(ui::WIDTH, ui::EQUAL, filledWidth),
@@ -198,31 +210,36 @@ public:
     /// @param msg The message to display (will auto-clear after `Config::StatusBarMessageDelay` seconds).
     void showMessage(std::string msg)
     {
-        const std::unique_lock guard(this->messageLock);
-        this->message = std::move(msg);
-        this->messageExpiry = std::chrono::steady_clock::now() + Config::StatusBarMessageDelay;
-        this->messageCv.notify_one();
+        {
+            const std::unique_lock guard(this->messageLock);
+            this->message = std::move(msg);
+            this->messageExpiry = std::chrono::steady_clock::now() + Config::StatusBarMessageDelay;
+        }
+        // Outside the lock, since replacing the timer waits out its task, which takes the lock.
+        this->messageTimer = Scheduler::after(Config::StatusBarMessageDelay, [this] { this->expireMessage(); });
     }
     /// @brief Clear the current message immediately.
     void clearMessage()
     {
-        const std::unique_lock guard(this->messageLock);
-        this->message.clear();
-        this->messageExpiry = std::chrono::steady_clock::time_point::min();
-        this->messageCv.notify_one();
+        {
+            const std::unique_lock guard(this->messageLock);
+            this->message.clear();
+            this->messageExpiry = std::chrono::steady_clock::time_point::min();
+        }
+        this->messageTimer.cancel();
     }
 
     /// @brief Show the last line of the most recent command's output in the status bar.
     /// @return Whether any output existed to show.
     bool showLastCommandOutput()
     {
-        const std::vector<CommandInvocation::Entry>& history = CommandInvocation::rawHistory();
+        const ConsoleHistory& history = CommandInvocation::rawHistory();
         _retif(false, history.empty());
 
-        const std::string& output = history.back().output;
-        _retif(false, output.empty());
+        const std::shared_ptr<const CommandInvocation::Entry> last = history.back();
+        _retif(false, last->output.empty());
 
-        this->showMessage(wstringLastLineTrimmed(output));
+        this->showMessage(wstringLastLineTrimmed(last->output));
         return true;
     }
 };
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <Preamble.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <initializer_list>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <module/sys>
+
+#include <HitTest.h>
+#include <Music.h>
+#include <TagIndex.h>
+
+/// @brief Tag selector pane, filtering the playlist to tracks matching the selected genres, artists and albums.
+/// @note
+/// Selected tags of one kind match any of them, and of different kinds, all of them. The first entry clears the selection. Virtualized like the playlist: the
+/// tag index is built off the UI thread and only swapped in here, and only the rows in view are labelled and laid out.
+class TagSelectImpl : public ui::ComponentBase, public std::enable_shared_from_this<TagSelectImpl>
+{
+    static constexpr i32 WheelStep = 3_i32;
+
+    /// @brief One line of the list.
+    struct Row
+    {
+        enum class Type : std::uint8_t
+        {
+            All,     // Clears the selection.
+            Blank,   // Before each heading.
+            Heading, // Names the kind of the tags after it.
+            Tag,
+        } type;
+        const Tag* tag = nullptr; // Of `Type::Heading` and `Type::Tag` rows, into `index`.
+        size_t tracks = 0;        // Carrying `tag`.
+
+        [[nodiscard]] bool selectable() const { return this->type == Type::All || this->type == Type::Tag; }
+    };
+
+    std::shared_ptr<const TagIndex> index; // What `rows` point into.
+    std::vector<Row> rows;
+    RowHitTester rowHits;
+    i32 visibleRows = 0_i32; // From `scrollTop` onwards.
+    ui::Box rowsBounds;
+    i32 hovered = i32::sentinel(), highlighted = 0_i32;
+    i32 scrollTop = 0_i32;
+    ui::Box bounds;
+
+    /// @brief Swap in the current tag index, keeping the highlight on the same tag if it's still there.
+    void syncIndex()
+    {
+        std::shared_ptr<const TagIndex> current = MusicPlayer::tags();
+        _retif(, current == this->index);
+
+        const bool onTag = this->highlighted > 0_i32 && this->highlighted < this->rows.size() && this->rows[sz(this->highlighted)].type == Row::Type::Tag;
+        const Tag kept = onTag ? *this->rows[sz(this->highlighted)].tag : Tag {};
+
+        this->index = std::move(current);
+        this->rows.clear();
+        this->rows.emplace_back(Row { .type = Row::Type::All, .tag = nullptr, .tracks = 0 });
+        this->highlighted = 0_i32;
+        for (const auto& [tag, tracks] : this->index->tags())
+        {
+            if (this->rows.back().type == Row::Type::All || this->rows.back().tag->kind != tag.kind)
+            {
+                this->rows.emplace_back(Row { .type = Row::Type::Blank, .tag = nullptr, .tracks = 0 });
+                this->rows.emplace_back(Row { .type = Row::Type::Heading, .tag = &tag, .tracks = 0 });
+            }
+            if (onTag && tag == kept)
+                this->highlighted = i32(this->rows.size());
+            this->rows.emplace_back(Row { .type = Row::Type::Tag, .tag = &tag, .tracks = tracks.size() });
+        }
+        this->clampScroll();
+    }
+
+    [[nodiscard]] i32 viewHeight() const
+    {
+        // Before the first frame, assume the list gets the whole terminal.
+        const int height = this->bounds.y_max >= this->bounds.y_min ? this->bounds.y_max - this->bounds.y_min + 1 : ui::Terminal::Size().dimy;
+        return std::max(i32(height), 1_i32);
+    }
+    void clampScroll()
+    {
+        const i32 size(this->rows.size());
+        if (this->highlighted < this->scrollTop)
+            this->scrollTop = this->highlighted;
+        else if (this->highlighted >= this->scrollTop + this->viewHeight())
+            this->scrollTop = this->highlighted - this->viewHeight() + 1_i32;
+        this->scrollTop = std::clamp(this->scrollTop, 0_i32, std::max(size - this->viewHeight(), 0_i32));
+    }
+    /// @brief Highlight the first selectable row from `from`, looking down (or up), or the other way if there's none that way.
+    void highlight(i32 from, bool down)
+    {
+        const i32 size(this->rows.size());
+        from = std::clamp(from, 0_i32, size - 1_i32);
+        for (const bool forwards : { down, !down })
+            for (i32 i = from; i >= 0_i32 && i < size; forwards ? ++i : --i)
+                if (this->rows[sz(i)].selectable())
+                {
+                    this->highlighted = i;
+                    this->clampScroll();
+                    return;
+                }
+    }
+
+    [[nodiscard]] ui::Element renderRow(i32 at, bool focused) const
+    {
+        const Row& row = this->rows[sz(at)];
+        const std::set<Tag>& filter = MusicPlayer::currentTagFilter();
+        switch (row.type)
+        {
+        case Row::Type::Blank:
+            return ui::text("");
+        case Row::Type::Heading:
+            return ui::text(std::string(Tag::kindName(row.tag->kind))) | ui::underlined;
+        case Row::Type::All:
+        case Row::Type::Tag:
+            break;
+        }
+
+        const bool selected = row.type == Row::Type::All ? filter.empty() : filter.contains(*row.tag);
+        ui::Element ret = ui::text(row.type == Row::Type::All ? std::string("> all") : std::format("{} {} ({})", selected ? '+' : ' ', row.tag->value, row.tracks));
+        if (focused && at == this->highlighted)
+            ret |= ui::inverted;
+        else if (at == this->hovered)
+            ret |= ui::underlined;
+        if (row.type == Row::Type::All && selected)
+            ret |= ui::bold;
+        else if (!selected)
+            ret |= ui::dim;
+        return ret;
+    }
+    [[nodiscard]] ui::Element renderScrollbar(i32 size) const
+    {
+        const i32 height = this->viewHeight();
+        _retif(ui::emptyElement(), size <= height);
+
+        const i32 thumbSize = std::max(height * height / size, 1_i32);
+        const i32 thumbTop = std::min(this->scrollTop * height / size, height - thumbSize);
+        ui::Elements ret;
+        for (i32 i = 0_i32; i < height; i++)
+            ret.emplace_back(ui::text(i >= thumbTop && i < thumbTop + thumbSize ? "┃" : " "));
+        return ui::vbox(std::move(ret));
+    }
+
+    void onEntryEnter()
+    {
+        std::set<Tag> filter;
+        if (const Row& row = this->rows[sz(this->highlighted)]; row.type == Row::Type::Tag)
+        {
+            filter = MusicPlayer::currentTagFilter();
+            if (const auto it = filter.find(*row.tag); it != filter.end())
+                filter.erase(it);
+            else
+                filter.insert(*row.tag);
+        }
+
+        (void)MusicPlayer::setTagFilter(std::move(filter));
+    }
+    /// @note Against the rows as last rendered, since that's what's on screen.
+    bool onEvent(const ui::Event& event)
+    {
+        const i32 size(this->rows.size());
+        if (event.is_mouse())
+        {
+            if (!this->bounds.Contain(event.mouse().x, event.mouse().y))
+            {
+                this->hovered = i32::sentinel();
+                return false;
+            }
+
+            if (event.mouse().button == ui::Mouse::WheelUp || event.mouse().button == ui::Mouse::WheelDown)
+            {
+                const i32 scrolled = event.mouse().button == ui::Mouse::WheelUp ? this->scrollTop - TagSelectImpl::WheelStep : this->scrollTop + TagSelectImpl::WheelStep;
+                this->scrollTop = std::clamp(scrolled, 0_i32, std::max(size - this->viewHeight(), 0_i32));
+                return true;
+            }
+            if (event.mouse().motion != ui::Mouse::Moved && (event.mouse().button != ui::Mouse::Left || event.mouse().motion != ui::Mouse::Pressed))
+                return false;
+
+            sys::result<sz> found = this->rowHits.rowAt(event.mouse().y - this->rowsBounds.y_min, sz(this->visibleRows));
+            if (!this->rowsBounds.Contain(event.mouse().x, event.mouse().y) || !found)
+                return false;
+
+            const i32 at = this->scrollTop + i32(found.move());
+            if (event.mouse().motion == ui::Mouse::Moved)
+                this->hovered = this->rows[sz(at)].selectable() ? at : i32::sentinel();
+            else if (this->rows[sz(at)].selectable())
+            {
+                this->highlighted = at;
+                this->displayComp->TakeFocus();
+            }
+            return true;
+        }
+
+        if (event == ui::Event::Return)
+        {
+            this->onEntryEnter();
+            return true;
+        }
+
+        const i32 old = this->highlighted;
+        if (event == ui::Event::ArrowUp)
+            this->highlight(this->highlighted - 1_i32, false);
+        else if (event == ui::Event::ArrowDown)
+            this->highlight(this->highlighted + 1_i32, true);
+        else if (event == ui::Event::PageUp)
+            this->highlight(this->highlighted - this->viewHeight(), false);
+        else if (event == ui::Event::PageDown)
+            this->highlight(this->highlighted + this->viewHeight(), true);
+        else if (event == ui::Event::Home)
+            this->highlight(0_i32, true);
+        else if (event == ui::Event::End)
+            this->highlight(size - 1_i32, false);
+        else
+            return false;
+
+        return this->highlighted != old;
+    }
+
+    ui::Component displayComp = ui::Renderer([this](bool focused)
+    {
+        this->syncIndex();
+        const i32 size(this->rows.size());
+        this->scrollTop = std::clamp(this->scrollTop, 0_i32, std::max(size - this->viewHeight(), 0_i32));
+        const i32 visibleTo = std::min(this->scrollTop + this->viewHeight(), size);
+
+        this->visibleRows = std::max(visibleTo - this->scrollTop, 0_i32);
+        ui::Elements rendered;
+        for (i32 i = this->scrollTop; i < visibleTo; i++)
+            rendered.emplace_back(this->renderRow(i, focused));
+
+        return ui::hbox({ ui::vbox(std::move(rendered)) | ui::xflex | ui::reflect(this->rowsBounds), this->renderScrollbar(size) }) | ui::yflex | ui::reflect(this->bounds);
+    }) | ui::CatchEvent([this](const ui::Event& event) { return this->onEvent(event); });
+public:
+    TagSelectImpl()
+    {
+        this->rowHits.uniform(1); // Rows are single `ui::text` lines.
+        this->syncIndex();
+        this->Add(this->displayComp);
+    }
+};
+
+/// @brief Create a tag selector component.
+inline ui::Component /* NOLINT(readability-identifier-naming) */ TagSelect() { return ui::Make<TagSelectImpl>(); }
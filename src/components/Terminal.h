@@ -4,20 +4,17 @@
 #include <Preamble.h>
 
 #include <cctype>
-#include <chrono>
-#include <condition_variable>
 #include <format>
 #include <memory>
-#include <mutex>
-#include <stop_token>
 #include <string>
-#include <thread>
 #include <utility>
 
 #include <module/sys>
 
 #include <CmdInv.h>
 #include <Config.h>
+#include <RenderScheduler.h>
+#include <Scheduler.h>
 #include <Screen.h>
 #include <components/StatusBar.h>
 
@@ -27,43 +24,22 @@ class TerminalImpl : public ui::ComponentBase, public std::enable_shared_from_th
 {
     std::string cmd;
 
-    std::chrono::steady_clock::time_point clearAfter = std::chrono::steady_clock::time_point::max();
-    std::mutex clearAfterLock;
-    std::condition_variable_any clearAfterCv;
-    std::jthread clearAfterThread { [this](std::stop_token token)
+    Timer quickActionTimer;
+
+    /// @brief Let the currently typed quick action live until `Config::QuickActionDelay` from now.
+    void resetQuickActionTimeout()
     {
-        while (!token.stop_requested())
+        this->quickActionTimer = Scheduler::after(Config::QuickActionDelay, [this]
         {
-            {
-                std::unique_lock guard(this->clearAfterLock);
-                this->clearAfterCv.wait(guard, token, [this]() { return this->clearAfter != std::chrono::steady_clock::time_point::max(); });
-                if (token.stop_requested())
-                    break;
-
-                this->clearAfterCv.wait_until(guard, token, this->clearAfter, [this]() { return std::chrono::steady_clock::now() >= this->clearAfter; });
-                if (token.stop_requested())
-                    break;
-
-                this->clearAfter = std::chrono::steady_clock::time_point::max();
-            }
-
             this->screen.Post([this]()
             {
                 if (!this->cmd.starts_with(Config::QuickActionKey) || this->cmd.size() <= 1uz)
                     return;
 
                 this->cmd = Config::QuickActionKey;
-                this->screen.PostEvent(ui::Event::Custom);
+                RenderScheduler::request();
             });
-        }
-    } };
-
-    /// @brief Let the currently typed quick action live until one second from now.
-    void resetQuickActionTimeout()
-    {
-        const std::unique_lock guard(this->clearAfterLock);
-        this->clearAfter = std::chrono::steady_clock::now() + Config::QuickActionDelay;
-        this->clearAfterCv.notify_one();
+        });
     }
 
     /// @brief Post-process an input element.
@@ -10,8 +10,10 @@
 
 #include <Config.h>
 #include <Style.h>
+#include <components/Details.h>
 #include <components/Playlist.h>
 #include <components/StatusBar.h>
+#include <components/TagSelect.h>
 #include <components/Terminal.h>
 
 class UIImpl : public ui::ComponentBase, public std::enable_shared_from_this<UIImpl>
@@ -19,9 +21,9 @@ class UIImpl : public ui::ComponentBase, public std::enable_shared_from_this<UII
     i32 leftSize = 20_i32;  // NOLINT(readability-magic-numbers)
     i32 rightSize = 32_i32; // NOLINT(readability-magic-numbers)
 
-    ui::Component tagSelectComp = ui::Renderer([] { return ui::text("> all") | ui::bold; });
+    ui::Component tagSelectComp = TagSelect();
     ui::Component playlistComp = Playlist();
-    ui::Component detailsComp = ui::Renderer([] { return ui::text("details here"); });
+    ui::Component detailsComp = Details();
 
     std::shared_ptr<StatusBarImpl> statBarComp = std::static_pointer_cast<StatusBarImpl>(StatusBar());
     ui::Component containerComp = ui::Container::Vertical({ [this]
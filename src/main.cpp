@@ -8,8 +8,10 @@
 #include <Config.h>
 #include <Debug.h>
 #include <Exec.h> // NOLINT(misc-include-cleaner)
+#include <RenderScheduler.h>
 #include <Screen.h>
 #include <Style.h>
+#include <Trace.h>
 #include <components/Console.h>
 #include <components/TabContainer.h>
 #include <components/TabSelect.h>
@@ -18,6 +20,7 @@
 
 int main()
 {
+    _trace_thread("main");
     try
     {
         ui::ScreenInteractive& screen = Screen();
@@ -38,7 +41,12 @@ int main()
             ui::Renderer(terminal, [&]() -> ui::Element { return hpad(terminal->Render()); }),
         });
 
-        const ui::Component uiRoot = ui::Renderer(rootContainer, [&]() -> ui::Element { return rootContainer->Render() | ui::borderStyled(UserSettings::border); }) |
+        const ui::Component uiRoot = ui::Renderer(rootContainer, [&]() -> ui::Element
+        {
+            _trace_scope("render");
+            RenderScheduler::frameRendered();
+            return rootContainer->Render() | ui::borderStyled(UserSettings::border);
+        }) |
             TerminalSpaceToFocusHandler(terminal) | TerminalQuickActionHandler(terminal) | ClipboardHandler();
 
         screen.Loop(uiRoot);